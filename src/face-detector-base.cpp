@@ -17,6 +17,7 @@ face_detector_base::face_detector_base()
 	pthread_cond_init(&cond, NULL);
 	request_stop = 0;
 	running = 0;
+	processing_ns = 0;
 	leak_test = bmalloc(1);
 }
 
@@ -40,6 +41,7 @@ void *face_detector_base::thread_routine(void *p)
 
 	base->lock();
 	while(!base->request_stop) {
+		uint64_t ns = os_gettime_ns();
 		try {
 			base->detect_main();
 		}
@@ -49,6 +51,7 @@ void *face_detector_base::thread_routine(void *p)
 		catch (...) {
 			blog(LOG_ERROR, "detect_main: unknown exception");
 		}
+		base->processing_ns = os_gettime_ns() - ns;
 		pthread_cond_wait(&base->cond, &base->mutex);
 	}
 	base->unlock();
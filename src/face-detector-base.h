@@ -14,6 +14,7 @@ class face_detector_base
 	bool running;
 	volatile bool request_stop;
 	void *leak_test;
+	uint64_t processing_ns;
 
 	static void* thread_routine(void *);
 	virtual void detect_main() = 0;
@@ -26,6 +27,7 @@ class face_detector_base
 		int trylock() { return pthread_mutex_trylock(&mutex); }
 		int unlock() { return pthread_mutex_unlock(&mutex); }
 		int signal() { return pthread_cond_signal(&cond); }
+		uint64_t get_processing_ns() const { return processing_ns; } // call with the lock held
 
 		virtual void set_texture(std::shared_ptr<class texture_object> &, int crop_l, int crop_r, int crop_t, int crop_b) = 0;
 		virtual void get_faces(std::vector<struct rect_s> &) = 0;
@@ -0,0 +1,216 @@
+#include <obs-module.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include "plugin-macros.generated.h"
+#include "face-detector-dlib-cnn-service.hpp"
+
+#include <dlib/dnn.h>
+#include <dlib/data_io.h>
+#include "face-detector-dlib-cnn-net.hpp"
+#ifndef _WIN32
+#include <sys/time.h>
+#include <sys/resource.h>
+#else // _WIN32
+#include <windows.h>
+#endif // _WIN32
+
+#define BATCH_WAIT_MS 2 // wait for other instances to submit their images to the same batch
+
+struct face_detector_dlib_cnn_model_s
+{
+	face_detector_dlib_cnn_net::net_type net;
+	bool has_error = false;
+};
+
+face_detector_dlib_cnn_service::face_detector_dlib_cnn_service()
+{
+	pthread_mutex_init(&mutex, NULL);
+	pthread_cond_init(&cond_request, NULL);
+	pthread_cond_init(&cond_done, NULL);
+	running = false;
+	stop_requested = false;
+}
+
+face_detector_dlib_cnn_service::~face_detector_dlib_cnn_service()
+{
+	// The thread has to be stopped by shutdown() before the module is unloaded.
+	pthread_cond_destroy(&cond_done);
+	pthread_cond_destroy(&cond_request);
+	pthread_mutex_destroy(&mutex);
+}
+
+face_detector_dlib_cnn_service &face_detector_dlib_cnn_service::get()
+{
+	static face_detector_dlib_cnn_service instance;
+	return instance;
+}
+
+void face_detector_dlib_cnn_service::shutdown()
+{
+	pthread_mutex_lock(&mutex);
+	if (!running) {
+		pthread_mutex_unlock(&mutex);
+		return;
+	}
+	stop_requested = true;
+	pthread_cond_signal(&cond_request);
+	pthread_mutex_unlock(&mutex);
+
+	pthread_join(thread, NULL);
+
+	// The thread has exited; nothing else touches the models.
+	models.clear();
+	running = false;
+	stop_requested = false;
+}
+
+bool face_detector_dlib_cnn_service::detect(const std::string &model, std::vector<image_t> &imgs, std::vector<std::vector<dlib::mmod_rect>> &dets)
+{
+	dets.resize(imgs.size());
+	std::vector<request_s> reqs(imgs.size());
+
+	pthread_mutex_lock(&mutex);
+	if (!running) {
+		blog(LOG_INFO, "face_detector_dlib_cnn_service: starting the thread.");
+		pthread_create(&thread, NULL, thread_routine, (void*)this);
+		running = true;
+	}
+
+	for (size_t i = 0; i < imgs.size(); i++) {
+		request_s &r = reqs[i];
+		r.model = &model;
+		r.img = &imgs[i];
+		r.dets = &dets[i];
+		r.done = false;
+		r.ok = false;
+		queue.push_back(&r);
+	}
+	pthread_cond_signal(&cond_request);
+
+	bool ok = true;
+	for (size_t i = 0; i < reqs.size(); i++) {
+		while (!reqs[i].done)
+			pthread_cond_wait(&cond_done, &mutex);
+		ok &= reqs[i].ok;
+	}
+	pthread_mutex_unlock(&mutex);
+
+	return ok;
+}
+
+void *face_detector_dlib_cnn_service::thread_routine(void *p)
+{
+#ifndef _WIN32
+	setpriority(PRIO_PROCESS, 0, 19);
+#else // _WIN32
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+#endif // _WIN32
+	os_set_thread_name("face-cnn");
+
+	((face_detector_dlib_cnn_service*)p)->service_main();
+	return NULL;
+}
+
+struct face_detector_dlib_cnn_model_s *face_detector_dlib_cnn_service::get_model(const std::string &model)
+{
+	// Called only from the service thread.
+	auto &m = models[model];
+	if (!m) {
+		m.reset(new face_detector_dlib_cnn_model_s);
+		try {
+			blog(LOG_INFO, "loading file '%s'", model.c_str());
+			dlib::deserialize(model.c_str()) >> m->net;
+		}
+		catch(...) {
+			blog(LOG_ERROR, "failed to load file '%s'", model.c_str());
+			m->has_error = true;
+		}
+	}
+	return m.get();
+}
+
+void face_detector_dlib_cnn_service::service_main()
+{
+	std::vector<request_s *> batch;
+	std::vector<image_t> imgs;
+
+	// Wait only when the queue has just become non-empty; the remaining batches are processed without waiting.
+	bool woken = true;
+
+	pthread_mutex_lock(&mutex);
+	while (!stop_requested) {
+		if (queue.empty()) {
+			pthread_cond_wait(&cond_request, &mutex);
+			woken = true;
+			continue;
+		}
+
+		if (woken) {
+			pthread_mutex_unlock(&mutex);
+			os_sleep_ms(BATCH_WAIT_MS);
+			pthread_mutex_lock(&mutex);
+			woken = false;
+		}
+
+		// Take the oldest request and all requests that can be processed together.
+		const request_s *r0 = queue.front();
+		const std::string model = *r0->model;
+		const long nr = r0->img->nr(), nc = r0->img->nc();
+		batch.clear();
+		for (auto it = queue.begin(); it != queue.end();) {
+			request_s *r = *it;
+			if (*r->model == model && r->img->nr() == nr && r->img->nc() == nc) {
+				batch.push_back(r);
+				it = queue.erase(it);
+			}
+			else
+				++it;
+		}
+
+		// The requesters are waiting; their images can be moved without the lock.
+		pthread_mutex_unlock(&mutex);
+
+		imgs.resize(batch.size());
+		for (size_t i = 0; i < batch.size(); i++)
+			imgs[i].swap(*batch[i]->img);
+
+		bool ok = false;
+		auto *m = get_model(model);
+		if (!m->has_error) {
+			try {
+				auto dets = m->net(imgs);
+				for (size_t i = 0; i < batch.size() && i < dets.size(); i++)
+					batch[i]->dets->swap(dets[i]);
+				ok = true;
+			}
+			catch (std::exception &e) {
+				blog(LOG_ERROR, "face_detector_dlib_cnn_service: exception %s", e.what());
+			}
+			catch (...) {
+				blog(LOG_ERROR, "face_detector_dlib_cnn_service: unknown exception");
+			}
+		}
+
+		pthread_mutex_lock(&mutex);
+		for (auto *r : batch) {
+			r->ok = ok;
+			r->done = true;
+		}
+		pthread_cond_broadcast(&cond_done);
+	}
+
+	// Release requesters left in the queue.
+	for (auto *r : queue) {
+		r->ok = false;
+		r->done = true;
+	}
+	queue.clear();
+	pthread_cond_broadcast(&cond_done);
+	pthread_mutex_unlock(&mutex);
+}
+
+extern "C"
+void face_detector_dlib_cnn_service_shutdown()
+{
+	face_detector_dlib_cnn_service::get().shutdown();
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <util/threading.h>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <dlib/image_processing.h>
+
+/*
+ * Runs the CNN detection for all detector instances in the process on one thread.
+ * The network is loaded once for each model file.
+ * Requests of the same model and the same image size are processed in one batch.
+ */
+class face_detector_dlib_cnn_service
+{
+	public:
+		typedef dlib::matrix<dlib::rgb_pixel> image_t;
+
+		static face_detector_dlib_cnn_service &get();
+
+		// Blocks until all images are processed. The images are consumed.
+		// Returns false if the model cannot be loaded.
+		bool detect(const std::string &model, std::vector<image_t> &imgs, std::vector<std::vector<dlib::mmod_rect>> &dets);
+
+		// Stops the thread and releases the networks. Called when the module is unloaded.
+		void shutdown();
+
+	private:
+		struct request_s
+		{
+			const std::string *model;
+			image_t *img;
+			std::vector<dlib::mmod_rect> *dets;
+			bool done;
+			bool ok;
+		};
+
+		pthread_t thread;
+		pthread_mutex_t mutex;
+		pthread_cond_t cond_request;
+		pthread_cond_t cond_done;
+		bool running;
+		bool stop_requested;
+		std::deque<request_s *> queue;
+		std::map<std::string, std::unique_ptr<struct face_detector_dlib_cnn_model_s>> models;
+
+		face_detector_dlib_cnn_service();
+		~face_detector_dlib_cnn_service();
+		static void *thread_routine(void *);
+		void service_main();
+		struct face_detector_dlib_cnn_model_s *get_model(const std::string &model);
+};
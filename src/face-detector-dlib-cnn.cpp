@@ -10,15 +10,11 @@
 #include <dlib/data_io.h>
 #include <dlib/image_processing.h>
 #include <dlib/array2d/array2d_kernel.h>
+#include "face-detector-dlib-cnn-service.hpp"
 
 #define MAX_ERROR 2
 
 using namespace dlib;
-template <long num_filters, typename SUBNET> using con5d = con<num_filters,5,5,2,2,SUBNET>;
-template <long num_filters, typename SUBNET> using con5  = con<num_filters,5,5,1,1,SUBNET>;
-template <typename SUBNET> using downsampler  = relu<affine<con5d<32, relu<affine<con5d<32, relu<affine<con5d<16,SUBNET>>>>>>>>>;
-template <typename SUBNET> using rcon5  = relu<affine<con5<45,SUBNET>>>;
-using net_type = loss_mmod<con<1,9,9,1,1,rcon5<rcon5<rcon5<downsampler<input_rgb_image_pyramid<pyramid_down<6>>>>>>>>;
 typedef dlib::matrix<dlib::rgb_pixel> image_t;
 
 struct private_s
@@ -26,9 +22,8 @@ struct private_s
 	std::shared_ptr<texture_object> tex;
 	std::vector<rect_s> rects;
 	std::string model_filename;
-	net_type net;
-	bool net_loaded = false;
-	bool has_error = false;
+	std::vector<image_t> imgs;
+	std::vector<std::vector<mmod_rect>> dets;
 	int crop_l = 0, crop_r = 0, crop_t = 0, crop_b = 0;
 	int n_error = 0;
 };
@@ -95,23 +90,13 @@ void face_detector_dlib_cnn::detect_main()
 		p->n_error--;
 	}
 
-	if (!p->net_loaded) {
-		p->net_loaded = true;
-		try {
-			blog(LOG_INFO, "loading file '%s'", p->model_filename.c_str());
-			deserialize(p->model_filename.c_str()) >> p->net;
-			p->has_error = false;
-		}
-		catch(...) {
-			blog(LOG_ERROR, "failed to load file '%s'", p->model_filename.c_str());
-			p->has_error = true;
-		}
-	}
-
-	if (p->has_error)
+	// The network is shared with other instances and runs on the service thread.
+	p->imgs.resize(1);
+	p->imgs[0].swap(img);
+	if (!face_detector_dlib_cnn_service::get().detect(p->model_filename, p->imgs, p->dets))
 		return;
 
-	auto dets = p->net(img);
+	const auto &dets = p->dets[0];
 	p->rects.resize(dets.size());
 	for (size_t i = 0; i < dets.size(); i++) {
 		auto &det = dets[i];
@@ -133,8 +118,5 @@ void face_detector_dlib_cnn::get_faces(std::vector<struct rect_s> &rects)
 
 void face_detector_dlib_cnn::set_model(const char *filename)
 {
-	if (p->model_filename != filename) {
-		p->model_filename = filename;
-		p->net_loaded = false;
-	}
+	p->model_filename = filename;
 }
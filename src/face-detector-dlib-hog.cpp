@@ -103,15 +103,17 @@ void face_detector_dlib_hog::detect_main()
 	}
 
 	if (!p->has_error) {
-		std::vector<dlib::rectangle> dets = p->detector(img);
+		std::vector<std::pair<double, dlib::rectangle>> dets;
+		p->detector(img, dets);
 		p->rects.resize(dets.size());
 		for (size_t i=0; i<dets.size(); i++) {
+			const dlib::rectangle &det = dets[i].second;
 			rect_s &r = p->rects[i];
-			r.x0 = (dets[i].left() + x0) * p->tex->scale;
-			r.y0 = (dets[i].top() + y0) * p->tex->scale;
-			r.x1 = (dets[i].right() + x0) * p->tex->scale;
-			r.y1 = (dets[i].bottom() + y0) * p->tex->scale;
-			r.score = 1.0; // TODO: implement me
+			r.x0 = (det.left() + x0) * p->tex->scale;
+			r.y0 = (det.top() + y0) * p->tex->scale;
+			r.x1 = (det.right() + x0) * p->tex->scale;
+			r.y1 = (det.bottom() + y0) * p->tex->scale;
+			r.score = dets[i].first;
 		}
 	}
 
@@ -0,0 +1,206 @@
+#include <obs-module.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include <string>
+#include "plugin-macros.generated.h"
+#include "face-detector-dlib-hybrid.h"
+#include "texture-object.h"
+
+#include <dlib/dnn.h>
+#include <dlib/data_io.h>
+#include <dlib/image_processing.h>
+#include <dlib/image_processing/frontal_face_detector.h>
+#include "face-detector-dlib-cnn-service.hpp"
+
+#define MAX_ERROR 2
+#define HOG_ADJUST_THRESHOLD -0.5 // lower than default to pass more candidates to CNN
+#define CNN_MIN_SIZE 80 // pixels, smaller window than this cannot be processed by the network
+
+typedef dlib::matrix<dlib::rgb_pixel> image_t;
+
+struct face_detector_dlib_hybrid_private_s
+{
+	std::shared_ptr<texture_object> tex;
+	std::vector<rect_s> rects;
+	std::string hog_model_filename;
+	std::string cnn_model_filename;
+	dlib::frontal_face_detector hog;
+	bool hog_loaded = false;
+	bool has_error = false;
+	std::vector<image_t> imgs;
+	std::vector<std::vector<dlib::mmod_rect>> dets;
+	std::vector<dlib::point> offsets;
+	int crop_l = 0, crop_r = 0, crop_t = 0, crop_b = 0;
+	int n_error = 0;
+	int full_interval = 5;
+	int n_run = 0;
+};
+
+face_detector_dlib_hybrid::face_detector_dlib_hybrid()
+{
+	p = new face_detector_dlib_hybrid_private_s;
+}
+
+face_detector_dlib_hybrid::~face_detector_dlib_hybrid()
+{
+	delete p;
+}
+
+void face_detector_dlib_hybrid::set_texture(std::shared_ptr<texture_object> &tex, int crop_l, int crop_r, int crop_t, int crop_b)
+{
+	p->tex = tex;
+	p->crop_l = crop_l;
+	p->crop_r = crop_r;
+	p->crop_t = crop_t;
+	p->crop_b = crop_b;
+}
+
+static inline bool load_hog(struct face_detector_dlib_hybrid_private_s *p)
+{
+	if (!p->hog_loaded) {
+		p->hog_loaded = true;
+		try {
+			blog(LOG_INFO, "loading file '%s'", p->hog_model_filename.c_str());
+			dlib::deserialize(p->hog_model_filename.c_str()) >> p->hog;
+			p->has_error = false;
+		}
+		catch(...) {
+			blog(LOG_ERROR, "failed to load file '%s'", p->hog_model_filename.c_str());
+			p->has_error = true;
+		}
+	}
+
+	return !p->has_error;
+}
+
+static inline void append_dets(std::vector<rect_s> &rects, const std::vector<dlib::mmod_rect> &dets, int x0, int y0, float scale)
+{
+	for (size_t i = 0; i < dets.size(); i++) {
+		auto &det = dets[i];
+		rect_s r;
+		r.x0 = (det.rect.left() + x0) * scale;
+		r.y0 = (det.rect.top() + y0) * scale;
+		r.x1 = (det.rect.right() + x0) * scale;
+		r.y1 = (det.rect.bottom() + y0) * scale;
+		r.score = det.detection_confidence;
+		rects.push_back(r);
+	}
+}
+
+void face_detector_dlib_hybrid::detect_main()
+{
+	if (!p->tex)
+		return;
+
+	image_t img;
+	if (!p->tex->get_dlib_rgb_image(img))
+		return;
+
+	int x0 = 0, y0 = 0;
+	if (p->crop_l > 0 || p->crop_r > 0 || p->crop_t > 0 || p->crop_b > 0) {
+		image_t img_crop;
+		x0 = (int)(p->crop_l / p->tex->scale);
+		int x1 = img.nc() - (int)(p->crop_r / p->tex->scale);
+		y0 = (int)(p->crop_t / p->tex->scale);
+		int y1 = img.nr() - (int)(p->crop_b / p->tex->scale);
+		if (x1 - x0 < 80 || y1 - y0 < 80) {
+			if (p->n_error++ < MAX_ERROR)
+				blog(LOG_ERROR, "too small image: %dx%d cropped left=%d right=%d top=%d bottom=%d",
+						(int)img.nc(), (int)img.nr(),
+						p->crop_l, p->crop_r, p->crop_t, p->crop_b );
+			return;
+		}
+		else if (p->n_error) {
+			p->n_error--;
+		}
+		img_crop.set_size(y1 - y0, x1 - x0);
+		for (int y = y0; y < y1; y++) {
+			for (int x = x0; x < x1; x++) {
+				img_crop(y-y0, x-x0) = img(y, x);
+			}
+		}
+		img = img_crop;
+	}
+	if (img.nc()<80 || img.nr()<80) {
+		if (p->n_error++ < MAX_ERROR)
+			blog(LOG_ERROR, "too small image: %dx%d", (int)img.nc(), (int)img.nr());
+		return;
+	}
+	else if (p->n_error) {
+		p->n_error--;
+	}
+
+	const float scale = p->tex->scale;
+	p->rects.clear();
+	p->imgs.clear();
+	p->offsets.clear();
+
+	// The error has been reported when loading; detect nothing as the HOG engine does.
+	if (!load_hog(p)) {
+		p->tex.reset();
+		return;
+	}
+
+	// Run CNN on the whole image periodically to find faces that HOG misses such as profile faces.
+	if (p->n_run++ % p->full_interval == 0) {
+		p->imgs.resize(1);
+		p->imgs[0].swap(img);
+		if (face_detector_dlib_cnn_service::get().detect(p->cnn_model_filename, p->imgs, p->dets))
+			append_dets(p->rects, p->dets[0], x0, y0, scale);
+		p->tex.reset();
+		return;
+	}
+
+	std::vector<std::pair<double, dlib::rectangle>> cands;
+	p->hog(img, cands, HOG_ADJUST_THRESHOLD);
+
+	// Verify each candidate by CNN on the window around it.
+	p->imgs.resize(cands.size());
+	p->offsets.resize(cands.size());
+	for (size_t i = 0; i < cands.size(); i++) {
+		const dlib::rectangle &c = cands[i].second;
+		const long c_size = (long)std::max(c.width(), c.height());
+		const long size = std::max(c_size * 2, (long)CNN_MIN_SIZE);
+		long wx0 = std::max((c.left() + c.right()) / 2 - size / 2, 0L);
+		long wy0 = std::max((c.top() + c.bottom()) / 2 - size / 2, 0L);
+		long wx1 = std::min(wx0 + size, img.nc());
+		long wy1 = std::min(wy0 + size, img.nr());
+		wx0 = std::max(wx1 - size, 0L);
+		wy0 = std::max(wy1 - size, 0L);
+
+		image_t &win = p->imgs[i];
+		win.set_size(wy1 - wy0, wx1 - wx0);
+		for (long y = wy0; y < wy1; y++) {
+			for (long x = wx0; x < wx1; x++) {
+				win(y-wy0, x-wx0) = img(y, x);
+			}
+		}
+		p->offsets[i] = dlib::point(x0 + wx0, y0 + wy0);
+	}
+
+	if (p->imgs.size() && face_detector_dlib_cnn_service::get().detect(p->cnn_model_filename, p->imgs, p->dets)) {
+		for (size_t i = 0; i < p->dets.size(); i++)
+			append_dets(p->rects, p->dets[i], p->offsets[i].x(), p->offsets[i].y(), scale);
+	}
+
+	p->tex.reset();
+}
+
+void face_detector_dlib_hybrid::get_faces(std::vector<struct rect_s> &rects)
+{
+	rects = p->rects;
+}
+
+void face_detector_dlib_hybrid::set_model(const char *hog_filename, const char *cnn_filename)
+{
+	if (p->hog_model_filename != hog_filename) {
+		p->hog_model_filename = hog_filename;
+		p->hog_loaded = false;
+	}
+	p->cnn_model_filename = cnn_filename;
+}
+
+void face_detector_dlib_hybrid::set_full_interval(int n)
+{
+	p->full_interval = n > 0 ? n : 1;
+}
@@ -0,0 +1,20 @@
+#include <obs-module.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include "plugin-macros.generated.h"
+#include "face-detector-base.h"
+
+class face_detector_dlib_hybrid : public face_detector_base
+{
+	struct face_detector_dlib_hybrid_private_s *p;
+
+	void detect_main() override;
+	public:
+		face_detector_dlib_hybrid();
+		virtual ~face_detector_dlib_hybrid();
+		void set_texture(std::shared_ptr<texture_object> &, int crop_l, int crop_r, int crop_t, int crop_b) override;
+		void get_faces(std::vector<struct rect_s> &) override;
+
+		void set_model(const char *hog_filename, const char *cnn_filename);
+		void set_full_interval(int n);
+};
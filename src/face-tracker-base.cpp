@@ -17,6 +17,7 @@ face_tracker_base::face_tracker_base()
 	pthread_cond_init(&cond, NULL);
 	stop_requested = 0;
 	running = 0;
+	processing_ns = 0;
 	leak_test = bmalloc(1);
 }
 
@@ -40,6 +41,7 @@ void *face_tracker_base::thread_routine(void *p)
 	base->lock();
 	while(!base->stop_requested) {
 		if (!base->suspend_requested) {
+			uint64_t ns = os_gettime_ns();
 			try {
 				base->track_main();
 			}
@@ -49,6 +51,7 @@ void *face_tracker_base::thread_routine(void *p)
 			catch (...) {
 				blog(LOG_ERROR, "track_main: unknown exception");
 			}
+			base->processing_ns = os_gettime_ns() - ns;
 		}
 		pthread_cond_wait(&base->cond, &base->mutex);
 	}
@@ -15,6 +15,7 @@ class face_tracker_base
 	volatile bool stopped;
 	volatile bool suspend_requested;
 	void *leak_test;
+	uint64_t processing_ns;
 
 	static void* thread_routine(void *);
 	virtual void track_main() = 0;
@@ -27,6 +28,7 @@ class face_tracker_base
 		int trylock() { return pthread_mutex_trylock(&mutex); }
 		int unlock() { return pthread_mutex_unlock(&mutex); }
 		int signal() { return pthread_cond_signal(&cond); }
+		uint64_t get_processing_ns() const { return processing_ns; } // call with the lock held
 
 		virtual void set_texture(std::shared_ptr<texture_object> &) = 0;
 		virtual void set_position(const rect_s &rect) = 0;
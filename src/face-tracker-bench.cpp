@@ -0,0 +1,190 @@
+#include <obs-module.h>
+#include <util/platform.h>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include "plugin-macros.generated.h"
+#include "helper.hpp"
+#include "rect-grid.hpp"
+#include "face-tracker-manager.hpp"
+
+/*
+ * Benchmark of the bookkeeping that runs on the video thread for each tick.
+ * Compares rect_grid with the loops over all the pairs of trackers and detections,
+ * and counts the allocations to publish the tracking results.
+ */
+
+#define WIDTH 1920
+#define HEIGHT 1080
+#define REPEAT 20000
+#define N_TICKS 10000
+#define N_LANDMARK 68
+
+static size_t n_alloc = 0;
+
+void *operator new(size_t size)
+{
+	n_alloc++;
+	void *p = malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+static void make_faces(std::vector<rect_s> &trackers, std::vector<rect_s> &detections, int n, std::mt19937 &rng)
+{
+	std::uniform_int_distribution<int> size_dist(60, 180);
+	std::uniform_int_distribution<int> jitter(-8, 8);
+
+	trackers.clear();
+	detections.clear();
+	for (int i = 0; i < n; i++) {
+		const int s = size_dist(rng);
+		const int x = std::uniform_int_distribution<int>(0, WIDTH - s)(rng);
+		const int y = std::uniform_int_distribution<int>(0, HEIGHT - s)(rng);
+		trackers.push_back(rect_s{x, y, x + s, y + s, 1.0f});
+		const int dx = jitter(rng), dy = jitter(rng);
+		detections.push_back(rect_s{x + dx, y + dy, x + s + dx, y + s + dy, 1.0f});
+	}
+}
+
+// Same as attenuate_tracker before the grid was introduced.
+static int64_t overlap_all_pairs(const std::vector<rect_s> &trackers, const std::vector<rect_s> &detections)
+{
+	int64_t sum = 0;
+	for (size_t i = 0; i < trackers.size(); i++) {
+		int amax = 0;
+		for (size_t j = 0; j < detections.size(); j++) {
+			int a = common_area(detections[j], trackers[i]);
+			if (a > amax) amax = a;
+		}
+		sum += amax;
+	}
+	return sum;
+}
+
+static int64_t overlap_grid(rect_grid &grid, const std::vector<rect_s> &trackers, const std::vector<rect_s> &detections)
+{
+	grid.clear();
+	for (size_t j = 0; j < detections.size(); j++)
+		grid.add(detections[j], (int)j);
+	grid.build();
+
+	int64_t sum = 0;
+	for (size_t i = 0; i < trackers.size(); i++) {
+		const rect_s &rt = trackers[i];
+		int amax = 0;
+		grid.query(rt, [&](int, const rect_s &r) {
+			int a = common_area(r, rt);
+			if (a > amax) amax = a;
+		});
+		sum += amax;
+	}
+	return sum;
+}
+
+static int bench_rect_grid()
+{
+	const int n_faces[] = {1, 2, 4, 8, 16, 24, 32, 40};
+	std::mt19937 rng(1);
+	std::vector<rect_s> trackers, detections;
+	rect_grid grid;
+	int n_failed = 0;
+
+	printf("%6s %14s %14s\n", "faces", "all pairs [us]", "grid [us]");
+	for (int n : n_faces) {
+		make_faces(trackers, detections, n, rng);
+
+		int64_t sum_all = 0, sum_grid = 0;
+		uint64_t t0 = os_gettime_ns();
+		for (int k = 0; k < REPEAT; k++)
+			sum_all += overlap_all_pairs(trackers, detections);
+		uint64_t t1 = os_gettime_ns();
+		for (int k = 0; k < REPEAT; k++)
+			sum_grid += overlap_grid(grid, trackers, detections);
+		uint64_t t2 = os_gettime_ns();
+
+		printf("%6d %14.3f %14.3f\n", n, (t1 - t0) * 1e-3 / REPEAT, (t2 - t1) * 1e-3 / REPEAT);
+		if (sum_all != sum_grid) {
+			fprintf(stderr, "faces=%d: grid found a different overlap\n", n);
+			n_failed++;
+		}
+	}
+	return n_failed;
+}
+
+/*
+ * Runs make_tracker_rects and the flip of the two buffers as tick() does.
+ * A tracker is retired and started again at every 10 ticks so that the number of results changes.
+ */
+static int bench_tracker_rects()
+{
+	const int n_faces[] = {1, 8, 40};
+	std::mt19937 rng(2);
+	std::vector<rect_s> rects, unused;
+	std::vector<pointf_s> lm(N_LANDMARK);
+	const rectf_s crop = {0.0f, 0.0f, (float)WIDTH, (float)HEIGHT};
+	int n_failed = 0;
+
+	printf("%6s %14s %14s %14s\n", "faces", "first 2 ticks", "after [alloc]", "tick [us]");
+	for (int n : n_faces) {
+		make_faces(rects, unused, n, rng);
+
+		face_tracker_manager::tracker_table_s trackers;
+		for (int i = 0; i < n; i++) {
+			size_t ix = trackers.add(NULL);
+			trackers.rect[ix] = rects[i];
+			trackers.crop_rect[ix] = crop;
+			trackers.att[ix] = 1.0f;
+			trackers.state[ix] = face_tracker_manager::tracker_state_available;
+			trackers.set_landmark(ix, lm);
+			trackers.motion[ix].reset(f3(rects[i]), 0);
+		}
+
+		face_tracker_manager::tracker_rects_s buf[2];
+		const face_tracker_manager::tracker_rects_s *cur = &buf[0];
+		size_t n_alloc_first = 0, n_alloc_after = 0;
+		uint64_t ns_sum = 0;
+		for (int tick = 1; tick <= N_TICKS; tick++) {
+			if (tick % 10 == 0) {
+				trackers.state[n - 1] = tick % 20 ?
+					face_tracker_manager::tracker_state_ending :
+					face_tracker_manager::tracker_state_available;
+			}
+			for (int i = 0; i < n; i++) {
+				rect_s &r = trackers.rect[i];
+				r.x0++;
+				r.x1++;
+				trackers.motion[i].update(f3(r), tick);
+			}
+
+			const size_t n_alloc_0 = n_alloc;
+			const uint64_t t0 = os_gettime_ns();
+			face_tracker_manager::tracker_rects_s *next = cur == &buf[0] ? &buf[1] : &buf[0];
+			make_tracker_rects(*next, trackers, true, tick, crop);
+			cur = next;
+			ns_sum += os_gettime_ns() - t0;
+			(tick <= 2 ? n_alloc_first : n_alloc_after) += n_alloc - n_alloc_0;
+		}
+
+		printf("%6d %14zu %14zu %14.3f\n", n, n_alloc_first, n_alloc_after, ns_sum * 1e-3 / N_TICKS);
+		if (n_alloc_after) {
+			fprintf(stderr, "faces=%d: publishing the results allocated after the buffers were filled\n", n);
+			n_failed++;
+		}
+	}
+	return n_failed;
+}
+
+int main()
+{
+	int n_failed = bench_rect_grid();
+	n_failed += bench_tracker_rects();
+	return n_failed ? 1 : 0;
+}
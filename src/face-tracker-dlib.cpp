@@ -103,8 +103,8 @@ void face_tracker_dlib::track_main()
 		if (!p->tracker)
 			p->tracker = new dlib::correlation_tracker();
 
-		dlib::matrix<dlib::rgb_pixel> img;
-		if (!p->tex->get_dlib_rgb_image(img))
+		dlib::matrix<unsigned char> img;
+		if (!p->tex->get_dlib_gray_image(img))
 			return;
 
 		dlib::rectangle r (p->rect.x0, p->rect.y0, p->rect.x1, p->rect.y1);
@@ -122,8 +122,8 @@ void face_tracker_dlib::track_main()
 		p->rect.score = 0.0f;
 	}
 	else {
-		dlib::matrix<dlib::rgb_pixel> img;
-		if (!p->tex->get_dlib_rgb_image(img))
+		dlib::matrix<unsigned char> img;
+		if (!p->tex->get_dlib_gray_image(img))
 			return;
 
 		if (img.nc() != p->tracker_nc || img.nr() != p->tracker_nr) {
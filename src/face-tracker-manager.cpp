@@ -1,11 +1,14 @@
 #include <obs-module.h>
+#include <algorithm>
 #include "plugin-macros.generated.h"
 #include "face-tracker-manager.hpp"
 #include "face-detector-dlib-hog.h"
 #include "face-detector-dlib-cnn.h"
+#include "face-detector-dlib-hybrid.h"
 #include "face-tracker-dlib.h"
 #include "texture-object.h"
 #include "helper.hpp"
+#include "face-tracker-scheduler.hpp"
 
 // #define debug_track(fmt, ...) blog(LOG_INFO, fmt, __VA_ARGS__)
 // #define debug_detect(fmt, ...) blog(LOG_INFO, fmt, __VA_ARGS__)
@@ -17,33 +20,56 @@
 #define DIR_DLIB_CNN "dlib_cnn_model"
 #define DIR_DLIB_LANDMARK "dlib_face_landmark_model"
 
+#define TRACKER_MATCH_IOU 0.3f
+
 face_tracker_manager::face_tracker_manager()
 {
 	upsize_l = upsize_r = upsize_t = upsize_b = 0.0f;
 	scale = 0.0f;
 	tracking_threshold = 1e-2f;
+	motion_prediction = false;
+	tracking_rate = 0.0f;
+	tracking_budget = false;
+	tracking_latency_max = 0.033f;
+	power_save = false;
+	suspended = false;
+	warm_requested = false;
+	detect_local = detect_local_in_progress = false;
+	local_crop_l = local_crop_r = local_crop_t = local_crop_b = 0;
+	tracking_rate_eff = tracking_rate_measured = tracking_latency = 0.0f;
+	detect_latency = 0.0f;
+	is_active = true;
+	drives_camera = false;
+	sched_rate_limit = 0.0f;
+	detect_interval = 2.0f;
+	time_cur = time_window = second_last = 0.0f;
+	n_results_window = 0;
+	detector_score_th = 0.0f;
+	detector_nms_th = 0.5f;
+	detector_hybrid_full_interval = 5;
 	landmark_detection_data = NULL;
 	crop_cur.x0 = crop_cur.x1 = crop_cur.y0 = crop_cur.y1 = 0.0f;
+	detect_crop = crop_cur;
 	tick_cnt = detect_tick = next_tick_stage_to_detector = 0;
 	detector_in_progress = false;
+	tracker_seq = 0;
+	tracker_rects = &tracker_rects_buf[0];
 	detect = NULL;
+
+	face_tracker_scheduler::get().add(this);
 }
 
 face_tracker_manager::~face_tracker_manager()
 {
-	for (auto &t : trackers_idlepool) {
-		if (t.tracker) {
-			t.tracker->stop();
-			delete t.tracker;
-			t.tracker = NULL;
-		}
+	face_tracker_scheduler::get().remove(this);
+
+	for (auto *t : trackers_idlepool) {
+		t->stop();
+		delete t;
 	}
-	for (auto &t : trackers) {
-		if (t.tracker) {
-			t.tracker->stop();
-			delete t.tracker;
-			t.tracker = NULL;
-		}
+	for (auto *t : trackers.tracker) {
+		t->stop();
+		delete t;
 	}
 	if (detect) {
 		detect->stop();
@@ -54,115 +80,284 @@ face_tracker_manager::~face_tracker_manager()
 
 inline void face_tracker_manager::retire_tracker(int ix)
 {
-	debug_track_thread("%p retire_tracker(%d %p)", this, ix, trackers[ix].tracker);
-	trackers_idlepool.push_back(trackers[ix]);
-	trackers[ix].tracker->request_suspend();
-	trackers.erase(trackers.begin()+ix);
+	debug_track_thread("%p retire_tracker(%d %p)", this, ix, trackers.tracker[ix]);
+	trackers_idlepool.push_back(trackers.tracker[ix]);
+	trackers.tracker[ix]->request_suspend();
+	trackers.remove(ix);
+}
+
+inline face_tracker_base *face_tracker_manager::get_idle_tracker()
+{
+	if (trackers_idlepool.size() > 0) {
+		face_tracker_base *tracker = trackers_idlepool.back();
+		trackers_idlepool.pop_back();
+		return tracker;
+	}
+
+	debug_track_thread("%p No available idle tracker, creating new tracker thread. There are %d existing thread.", this, trackers.size());
+	for (size_t i = 0; i < trackers.size(); i++) {
+		debug_track_thread("%p existing tracker[%d]: state=%d", this, i, (int)trackers.state[i]);
+	}
+	return new face_tracker_dlib();
 }
 
-inline bool face_tracker_manager::is_low_confident(const tracker_inst_s &t, float th1)
+inline bool face_tracker_manager::is_low_confident(size_t i, float th1)
 {
-	if (t.att * t.rect.score <= th1)
+	const float s = trackers.att[i] * trackers.rect[i].score;
+
+	if (s <= th1)
 		return true;
 
-	if (t.att * t.rect.score <= tracking_threshold * t.score_first)
+	if (s <= tracking_threshold * trackers.score_first[i])
 		return true;
 
 	return false;
 }
 
+static inline float detection_rank(const rect_s &r)
+{
+	// Prefer confident and large faces.
+	return r.score * sqrtf((float)get_area(r));
+}
+
+void face_tracker_manager::filter_detections()
+{
+	size_t n = 0;
+	for (size_t i = 0; i < detect_rects.size(); i++) {
+		const rect_s &r = detect_rects[i];
+		if (r.score < detector_score_th || get_area(r) <= 0)
+			continue;
+		detect_rects[n++] = r;
+	}
+	detect_rects.resize(n);
+
+	std::sort(detect_rects.begin(), detect_rects.end(), [](const rect_s &a, const rect_s &b) {
+		return detection_rank(a) > detection_rank(b);
+	});
+
+	n = 0;
+	for (size_t i = 0; i < detect_rects.size(); i++) {
+		bool suppressed = false;
+		for (size_t j = 0; j < n && !suppressed; j++) {
+			if (iou(detect_rects[i], detect_rects[j]) > detector_nms_th)
+				suppressed = true;
+		}
+		if (!suppressed)
+			detect_rects[n++] = detect_rects[i];
+	}
+	detect_rects.resize(n);
+}
+
 void face_tracker_manager::remove_duplicated_tracker()
 {
+	grid.clear();
 	for (size_t i = 0; i < trackers.size(); i++) {
-		if (trackers[i].state != tracker_inst_s::tracker_state_available)
+		if (trackers.state[i] == tracker_state_available)
+			grid.add(trackers.rect[i], (int)i);
+	}
+	grid.build();
+
+	// An older tracker is removed if newer trackers cover it.
+	// Retiring a tracker does not change the decision for the older trackers,
+	// so decide all of them first and then retire.
+	to_remove.assign(trackers.size(), false);
+	for (size_t i = 0; i < trackers.size(); i++) {
+		if (trackers.state[i] != tracker_state_available)
 			continue;
 
-		rect_s r = trackers[i].rect;
+		rect_s r = trackers.rect[i];
 		int a0 = (r.x1 - r.x0) * (r.y1 - r.y0);
+
+		grid_hits.clear();
+		grid.query(r, [&](int j, const rect_s &) {
+			if ((int32_t)(trackers.seq[j] - trackers.seq[i]) > 0)
+				grid_hits.push_back(j);
+		});
+		std::sort(grid_hits.begin(), grid_hits.end(), [this](int a, int b) {
+			return (int32_t)(trackers.seq[a] - trackers.seq[b]) < 0;
+		});
+
 		int a_overlap_sum = 0;
-		bool to_remove = false;
-		for (size_t j = i + 1; j < trackers.size() && !to_remove; j++) {
-			if (trackers[j].state != tracker_inst_s::tracker_state_available)
-				continue;
-			int a = common_area(r, trackers[j].rect);
+		for (size_t k = 0; k < grid_hits.size() && !to_remove[i]; k++) {
+			int a = common_area(r, trackers.rect[grid_hits[k]]);
 			a_overlap_sum += a;
 			if (a*10>a0 && a_overlap_sum*2 > a0)
-				to_remove = true;
+				to_remove[i] = true;
 		}
+	}
 
-		if (to_remove) {
-			retire_tracker(i);
-			i--;
-		}
+	for (size_t i = trackers.size(); i > 0; i--) {
+		if (to_remove[i - 1])
+			retire_tracker(i - 1);
 	}
 }
 
 inline void face_tracker_manager::attenuate_tracker()
 {
+	grid.clear();
+	for (size_t j = 0; j < detect_rects.size(); j++)
+		grid.add(detect_rects[j], (int)j);
+	grid.build();
+
 	for (size_t i = 0; i < trackers.size(); i++) {
-		if (trackers[i].state != tracker_inst_s::tracker_state_available)
+		if (trackers.state[i] != tracker_state_available)
 			continue;
-		struct tracker_inst_s &t = trackers[i];
+		const rect_s &rt = trackers.rect[i];
 
-		int a1 = (t.rect.x1 - t.rect.x0) * (t.rect.y1 - t.rect.y0);
+		int a1 = (rt.x1 - rt.x0) * (rt.y1 - rt.y0);
 		float amax = (float)a1*0.1f;
-		for (size_t j = 0; j < detect_rects.size(); j++) {
-			rect_s r = detect_rects[j];
-			float a = (float)common_area(r, t.rect);
+		grid.query(rt, [&](int, const rect_s &r) {
+			float a = (float)common_area(r, rt);
 			if (a > amax) amax = a;
-		}
+		});
 
-		t.att *= powf(amax / a1, 0.1f); // if no faces, remove the tracker
+		trackers.att[i] *= powf(amax / a1, 0.1f); // if no faces, remove the tracker
 	}
 
 	float score_max = 1e-17f;
 	for (size_t i = 0; i < trackers.size(); i++) {
-		if (trackers[i].state == tracker_inst_s::tracker_state_available) {
-			float s = trackers[i].att * trackers[i].rect.score;
+		if (trackers.state[i] == tracker_state_available) {
+			float s = trackers.att[i] * trackers.rect[i].score;
 			if (s > score_max) score_max = s;
 		}
 	}
 
-	for (size_t i = 0; i < trackers.size(); i++) {
-		if (trackers[i].state != tracker_inst_s::tracker_state_available)
+	for (size_t i = trackers.size(); i > 0; i--) {
+		if (trackers.state[i - 1] != tracker_state_available)
 			continue;
-		if (!is_low_confident(trackers[i], 1e-2f * score_max))
+		if (!is_low_confident(i - 1, 1e-2f * score_max))
 			continue;
 
-		retire_tracker(i);
-		i--;
+		retire_tracker(i - 1);
 	}
 }
 
 inline void face_tracker_manager::copy_detector_to_tracker()
 {
-	size_t i_tracker;
-	for (i_tracker=0; i_tracker < trackers.size(); i_tracker++)
-		if (
-				trackers[i_tracker].tick_cnt == detect_tick &&
-				trackers[i_tracker].state==tracker_inst_s::tracker_state_e::tracker_state_reset_texture )
-			break;
-	if (i_tracker >= trackers.size())
+	if (!detect_cvtex)
 		return;
 
-	if (detect_rects.size()<=0) {
-		retire_tracker(i_tracker);
+	grid.clear();
+	for (size_t j = 0; j < trackers.size(); j++)
+		grid.add(trackers.rect[j], (int)j);
+	grid.build();
+
+	for (size_t i = 0; i < detect_rects.size(); i++) {
+		struct rect_s r = detect_rects[i];
+		int w = r.x1-r.x0;
+		int h = r.y1-r.y0;
+		r.x0 -= w * upsize_l;
+		r.x1 += w * upsize_r;
+		r.y0 -= h * upsize_t;
+		r.y1 += h * upsize_b;
+
+		// The face is already tracked or being started to track.
+		bool matched = false;
+		grid.query(r, [&](int, const rect_s &rt) {
+			if (iou(r, rt) > TRACKER_MATCH_IOU)
+				matched = true;
+		});
+		if (matched)
+			continue;
+
+		start_tracker(r, detect_cvtex, detect_crop, detect_tick);
+	}
+
+	detect_cvtex.reset();
+}
+
+void face_tracker_manager::start_tracker(const rect_s &r, std::shared_ptr<texture_object> &cvtex, const rectf_s &crop, int tick)
+{
+	face_tracker_base *tracker = get_idle_tracker();
+	size_t k = trackers.add(tracker);
+	trackers.rect[k] = r;
+	trackers.rect[k].score = 0.0f;
+	trackers.crop_tracker[k] = crop;
+	trackers.state[k] = tracker_state_constructing;
+	trackers.tick_cnt[k] = tick;
+	trackers.tick_tracker[k] = cvtex->tick;
+	trackers.seq[k] = tracker_seq++;
+	tracker->set_texture(cvtex);
+	tracker->set_landmark_detection(landmark_detection_data);
+	tracker->set_position(r);
+	tracker->set_upsize_info(rectf_s{upsize_l, upsize_t, upsize_r, upsize_b});
+	tracker->start();
+	debug_track("start_tracker: starting tracker %p for %d %d %d %d", tracker, r.x0, r.y0, r.x1, r.y1);
+}
+
+void face_tracker_manager::save_warm_rects()
+{
+	warm_rects.clear();
+	for (size_t i = 0; i < trackers.size(); i++) {
+		if (trackers.state[i] != tracker_state_available)
+			continue;
+		if (trackers.att[i] * trackers.rect[i].score <= 0.0f)
+			continue;
+		warm_rects.push_back(trackers.rect[i]);
+	}
+}
+
+void face_tracker_manager::warm_start()
+{
+	if (warm_rects.empty()) {
+		warm_requested = false;
 		return;
 	}
 
-	struct tracker_inst_s &t = trackers[i_tracker];
+	// Nothing is staged while suspended; wait until a frame staged after the resume arrives
+	// so that the trackers won't start on an old image.
+	auto cvtex = get_cvtex();
+	if (!cvtex || tick_cnt - cvtex->tick > 1)
+		return;
+	warm_requested = false;
+
+	rect_s u = warm_rects[0];
+	for (size_t i = 0; i < warm_rects.size(); i++) {
+		const rect_s &r = warm_rects[i];
+		start_tracker(r, cvtex, crop_cur, tick_cnt);
+		trackers.warm[trackers.size() - 1] = true;
+		if (r.x0 < u.x0) u.x0 = r.x0;
+		if (r.y0 < u.y0) u.y0 = r.y0;
+		if (r.x1 > u.x1) u.x1 = r.x1;
+		if (r.y1 > u.y1) u.y1 = r.y1;
+	}
+	warm_rects.clear();
+
+	// Verify the boxes by a detection only around them, which is much cheaper than the whole frame.
+	const int width = (int)(cvtex->get_width() * cvtex->scale);
+	const int height = (int)(cvtex->get_height() * cvtex->scale);
+	const int pad = std::max(u.x1 - u.x0, u.y1 - u.y0) / 2;
+	local_crop_l = std::max(u.x0 - pad, 0);
+	local_crop_r = std::max(width - (u.x1 + pad), 0);
+	local_crop_t = std::max(u.y0 - pad, 0);
+	local_crop_b = std::max(height - (u.y1 + pad), 0);
+	detect_local = true;
+	next_tick_stage_to_detector = tick_cnt;
+}
+
+void face_tracker_manager::verify_warm_trackers()
+{
+	for (size_t i = trackers.size(); i > 0; i--) {
+		if (!trackers.warm[i - 1])
+			continue;
+		trackers.warm[i - 1] = false;
+
+		bool matched = false;
+		for (size_t j = 0; j < detect_rects.size() && !matched; j++) {
+			rect_s r = detect_rects[j];
+			int w = r.x1-r.x0;
+			int h = r.y1-r.y0;
+			r.x0 -= w * upsize_l;
+			r.x1 += w * upsize_r;
+			r.y0 -= h * upsize_t;
+			r.y1 += h * upsize_b;
+			if (iou(r, trackers.rect[i - 1]) > TRACKER_MATCH_IOU)
+				matched = true;
+		}
 
-	struct rect_s r = detect_rects[0];
-	int w = r.x1-r.x0;
-	int h = r.y1-r.y0;
-	r.x0 -= w * upsize_l;
-	r.x1 += w * upsize_r;
-	r.y0 -= h * upsize_t;
-	r.y1 += h * upsize_b;
-	t.tracker->set_position(r); // TODO: consider how to track two or more faces.
-	t.tracker->set_upsize_info(rectf_s{upsize_l, upsize_t, upsize_r, upsize_b});
-	t.tracker->start();
-	t.state = tracker_inst_s::tracker_state_constructing;
+		if (!matched)
+			retire_tracker(i - 1);
+	}
 }
 
 inline void face_tracker_manager::stage_to_detector()
@@ -173,10 +368,15 @@ inline void face_tracker_manager::stage_to_detector()
 	// get previous results
 	if (detector_in_progress) {
 		detect->get_faces(detect_rects);
+		detect_latency = detect->get_processing_ns() * 1e-9f;
+		filter_detections();
 		for (size_t i = 0; i < detect_rects.size(); i++)
 			debug_detect("stage_to_detector: detect_rects %d %d %d %d %d %f", i,
 					detect_rects[i].x0, detect_rects[i].y0, detect_rects[i].x1, detect_rects[i].y1, detect_rects[i].score );
-		attenuate_tracker();
+		if (detect_local_in_progress)
+			verify_warm_trackers();
+		else
+			attenuate_tracker();
 		copy_detector_to_tracker();
 		detector_in_progress = false;
 	}
@@ -187,9 +387,18 @@ inline void face_tracker_manager::stage_to_detector()
 	}
 
 	if (auto cvtex = get_cvtex()) {
-		detect->set_texture(cvtex,
-				detector_crop_l, detector_crop_r,
-				detector_crop_t, detector_crop_b );
+		if (detect_local) {
+			detect->set_texture(cvtex,
+					std::max(detector_crop_l, local_crop_l), std::max(detector_crop_r, local_crop_r),
+					std::max(detector_crop_t, local_crop_t), std::max(detector_crop_b, local_crop_b) );
+		}
+		else {
+			detect->set_texture(cvtex,
+					detector_crop_l, detector_crop_r,
+					detector_crop_t, detector_crop_b );
+		}
+		detect_local_in_progress = detect_local;
+		detect_local = false;
 		if (detector_engine == engine_dlib_hog) {
 			if (auto *d = dynamic_cast<face_detector_dlib_hog*>(detect))
 				d->set_model(detector_dlib_hog_model.c_str());
@@ -198,46 +407,32 @@ inline void face_tracker_manager::stage_to_detector()
 			if (auto *d = dynamic_cast<face_detector_dlib_cnn*>(detect))
 				d->set_model(detector_dlib_cnn_model.c_str());
 		}
+		else if (detector_engine == engine_dlib_hybrid) {
+			if (auto *d = dynamic_cast<face_detector_dlib_hybrid*>(detect)) {
+				d->set_model(detector_dlib_hog_model.c_str(), detector_dlib_cnn_model.c_str());
+				d->set_full_interval(detector_hybrid_full_interval);
+			}
+		}
 		detect->signal();
 		detector_in_progress = true;
 		detect_tick = tick_cnt;
 
-		struct tracker_inst_s t;
-		t.rect = rect_s{0, 0, 0, 0, 0.0f};
-		t.crop_rect = rectf_s{0.0f, 0.0f, 0.0f, 0.0f};
-		t.att = 0.0f;
-		t.score_first = 0.0f;
-		if (trackers_idlepool.size() > 0) {
-			t.tracker = trackers_idlepool[0].tracker;
-			trackers_idlepool[0].tracker = NULL;
-			trackers_idlepool.pop_front();
-		}
-		else {
-			debug_track_thread("%p No available idle tracker, creating new tracker thread. There are %d existing thread.", this, trackers.size());
-			t.tracker = new face_tracker_dlib();
-			for (size_t i = 0; i < trackers.size(); i++) {
-				debug_track_thread("%p existing tracker[%d]: state=%d", this, i, (int)trackers[i].state);
-			}
-		}
-		t.crop_tracker = crop_cur;
-		t.state = tracker_inst_s::tracker_state_e::tracker_state_reset_texture;
-		t.tick_cnt = tick_cnt;
-		t.tracker->set_texture(cvtex);
-		t.tracker->set_landmark_detection(landmark_detection_data);
-		if (!landmark_detection_data)
-			t.landmark.clear();
-		trackers.push_back(t);
+		// Keep the frame to start trackers for the detected faces.
+		detect_cvtex = cvtex;
+		detect_crop = crop_cur;
 	}
 
 	detect->unlock();
 }
 
-inline int face_tracker_manager::stage_surface_to_tracker(struct tracker_inst_s &t)
+inline int face_tracker_manager::stage_surface_to_tracker(size_t i)
 {
 	if (auto cvtex = get_cvtex()) {
-		t.tracker->set_texture(cvtex);
-		t.crop_tracker = crop_cur;
-		t.tracker->signal();
+		trackers.tracker[i]->set_texture(cvtex);
+		trackers.crop_tracker[i] = crop_cur;
+		trackers.tick_tracker[i] = cvtex->tick;
+		trackers.time_staged[i] = time_cur;
+		trackers.tracker[i]->signal();
 	}
 	else
 		return 1;
@@ -248,45 +443,59 @@ inline void face_tracker_manager::stage_to_trackers()
 {
 	bool have_new_tracker = false;
 	for (size_t i = 0; i < trackers.size(); i++) {
-		struct tracker_inst_s &t = trackers[i];
-		if (t.state == tracker_inst_s::tracker_state_constructing) {
-			if (!t.tracker->trylock()) {
-				if (!stage_surface_to_tracker(t)) {
-					t.crop_tracker = crop_cur;
-					t.state = tracker_inst_s::tracker_state_first_track;
-				}
-				t.tracker->unlock();
-				t.state = tracker_inst_s::tracker_state_first_track;
+		face_tracker_base *tracker = trackers.tracker[i];
+		rect_s &rect = trackers.rect[i];
+		enum tracker_state_e &state = trackers.state[i];
+		if (state == tracker_state_constructing) {
+			if (!tracker->trylock()) {
+				if (!stage_surface_to_tracker(i))
+					trackers.crop_tracker[i] = crop_cur;
+				tracker->unlock();
+				state = tracker_state_first_track;
 			}
 		}
-		else if (t.state == tracker_inst_s::tracker_state_first_track) {
-			if (!t.tracker->trylock()) {
-				bool ret = t.tracker->get_face(t.rect);
-				t.crop_rect = t.crop_tracker;
-				debug_track("tracker_state_first_track %p %d %d %d %d %f", t.tracker, t.rect.x0, t.rect.y0, t.rect.x1, t.rect.y1, t.rect.score);
-				t.att = 1.0f;
-				t.score_first = t.rect.score;
-				if (!ret || !landmark_detection_data || !t.tracker->get_landmark(t.landmark))
-					t.landmark.resize(0);
-				stage_surface_to_tracker(t);
-				t.tracker->signal();
-				t.tracker->unlock();
+		else if (state == tracker_state_first_track) {
+			if (!tracker->trylock()) {
+				bool ret = tracker->get_face(rect);
+				trackers.crop_rect[i] = trackers.crop_tracker[i];
+				trackers.tick_rect[i] = trackers.tick_tracker[i];
+				if (ret)
+					trackers.motion[i].reset(f3(rect), trackers.tick_rect[i]);
+				debug_track("tracker_state_first_track %p %d %d %d %d %f", tracker, rect.x0, rect.y0, rect.x1, rect.y1, rect.score);
+				trackers.att[i] = 1.0f;
+				trackers.score_first[i] = rect.score;
+				if (ret && landmark_detection_data && tracker->get_landmark(landmark_tmp))
+					trackers.set_landmark(i, landmark_tmp);
+				else
+					trackers.n_landmark[i] = 0;
+				stage_surface_to_tracker(i);
+				tracker->signal();
+				tracker->unlock();
 				if (ret) {
-					t.state = tracker_inst_s::tracker_state_available;
+					state = tracker_state_available;
 					have_new_tracker = true;
 				}
 			}
 		}
-		else if (t.state == tracker_inst_s::tracker_state_available) {
-			if (!t.tracker->trylock()) {
-				bool ret = t.tracker->get_face(t.rect);
-				t.crop_rect = t.crop_tracker;
-				debug_track("tracker_state_available %p %d %d %d %d %f landmark=%d", t.tracker, t.rect.x0, t.rect.y0, t.rect.x1, t.rect.y1, t.rect.score, t.landmark.size());
-				if (!ret || !landmark_detection_data || !t.tracker->get_landmark(t.landmark))
-					t.landmark.resize(0);
-				stage_surface_to_tracker(t);
-				t.tracker->signal();
-				t.tracker->unlock();
+		else if (state == tracker_state_available) {
+			if (!is_tracking_due(i))
+				continue;
+			if (!tracker->trylock()) {
+				tracking_latency += (tracker->get_processing_ns() * 1e-9f - tracking_latency) * 0.1f;
+				n_results_window++;
+				bool ret = tracker->get_face(rect);
+				trackers.crop_rect[i] = trackers.crop_tracker[i];
+				trackers.tick_rect[i] = trackers.tick_tracker[i];
+				if (ret)
+					trackers.motion[i].update(f3(rect), trackers.tick_rect[i]);
+				if (ret && landmark_detection_data && tracker->get_landmark(landmark_tmp))
+					trackers.set_landmark(i, landmark_tmp);
+				else
+					trackers.n_landmark[i] = 0;
+				debug_track("tracker_state_available %p %d %d %d %d %f landmark=%d", tracker, rect.x0, rect.y0, rect.x1, rect.y1, rect.score, trackers.n_landmark[i]);
+				stage_surface_to_tracker(i);
+				tracker->signal();
+				tracker->unlock();
 			}
 		}
 	}
@@ -295,57 +504,152 @@ inline void face_tracker_manager::stage_to_trackers()
 		remove_duplicated_tracker();
 }
 
-static inline void make_tracker_rects(
-		std::vector<face_tracker_manager::tracker_rect_s> &tracker_rects,
-		const std::deque<face_tracker_manager::tracker_inst_s> &trackers )
+inline bool face_tracker_manager::is_tracking_due(size_t i, float ahead) const
 {
-	size_t n = 0;
-	for (size_t i = 0; i < trackers.size(); i++) {
-		if (trackers[i].state != face_tracker_manager::tracker_inst_s::tracker_state_available)
-			continue;
+	if (tracking_rate_eff <= 0.0f)
+		return true;
 
-		float score = trackers[i].rect.score * trackers[i].att;
+	// Allow half a frame earlier so that the rate won't be rounded down to the next frame.
+	return time_cur + ahead - trackers.time_staged[i] >= 1.0f / tracking_rate_eff - second_last * 0.5f;
+}
 
-		if (score<=0.0f || isnan(score))
-			continue;
+#define TRACKING_RATE_MIN 5.0f
 
-		if (tracker_rects.size() <= n)
-			tracker_rects.resize(n+1);
-		auto &r = tracker_rects[n++];
+void face_tracker_manager::update_tracking_rate(float second)
+{
+	const float rate_max = tracking_rate > 0.0f ? tracking_rate : second > 0.0f ? 1.0f / second : 0.0f;
 
-		r.rect = trackers[i].rect;
-		r.rect.score = score;
-		r.crop_rect = trackers[i].crop_rect;
-		r.landmark = trackers[i].landmark;
+	if (!tracking_budget || rate_max <= TRACKING_RATE_MIN) {
+		tracking_rate_eff = tracking_rate;
+	}
+	else {
+		if (tracking_rate_eff <= 0.0f || tracking_rate_eff > rate_max)
+			tracking_rate_eff = rate_max;
+		if (tracking_latency > tracking_latency_max)
+			tracking_rate_eff *= powf(0.5f, second);
+		else if (tracking_latency < tracking_latency_max * 0.5f)
+			tracking_rate_eff *= powf(1.25f, second);
+		if (tracking_rate_eff < TRACKING_RATE_MIN)
+			tracking_rate_eff = TRACKING_RATE_MIN;
+		if (tracking_rate_eff > rate_max)
+			tracking_rate_eff = rate_max;
 	}
 
-	if (tracker_rects.size() > n)
-		tracker_rects.resize(n);
+	if (sched_rate_limit > 0.0f && (tracking_rate_eff <= 0.0f || tracking_rate_eff > sched_rate_limit))
+		tracking_rate_eff = sched_rate_limit;
+
+	time_window += second;
+	if (time_window >= 1.0f) {
+		int n_available = 0;
+		for (size_t i = 0; i < trackers.size(); i++) {
+			if (trackers.state[i] == tracker_state_available)
+				n_available++;
+		}
+		tracking_rate_measured = n_available ? n_results_window / (n_available * time_window) : 0.0f;
+		n_results_window = 0;
+		time_window = 0.0f;
+	}
 }
 
 void face_tracker_manager::tick(float second)
 {
 	if (reset_requested) {
-		for (int i=trackers.size()-1; i>=0; i--)
-			trackers[i].att = 0.0f;
+		// Discard the boxes and look for the faces in the whole frame.
+		for (size_t i = trackers.size(); i > 0; i--)
+			retire_tracker(i - 1);
 		detect_rects.clear();
+		warm_rects.clear();
+		warm_requested = false;
+		detect_local = false;
+		next_tick_stage_to_detector = tick_cnt;
 		reset_requested = false;
 	}
 
 	if (detect_tick==tick_cnt)
-		next_tick_stage_to_detector = tick_cnt + (int)(2.0f/second); // detect for each _ second(s).
+		next_tick_stage_to_detector = tick_cnt + (int)(detect_interval/second);
+
+	time_cur += second;
+	second_last = second;
+	face_tracker_scheduler::get().tick();
+	update_tracking_rate(second);
 
 	tick_cnt += 1;
 
-	make_tracker_rects(tracker_rects, trackers);
+	tracker_rects_s *next = tracker_rects == &tracker_rects_buf[0] ? &tracker_rects_buf[1] : &tracker_rects_buf[0];
+	make_tracker_rects(*next, trackers, motion_prediction, tick_cnt, crop_cur);
+	tracker_rects = next;
+}
+
+void face_tracker_manager::suspend()
+{
+	debug_track_thread("%p suspend", this);
+	save_warm_rects();
+	for (size_t i = trackers.size(); i > 0; i--)
+		retire_tracker(i - 1);
+
+	// A detection in progress is not used to start trackers since it will be stale.
+	detect_cvtex.reset();
+	suspended = true;
+}
+
+void face_tracker_manager::resume()
+{
+	debug_track_thread("%p resume", this);
+	next_tick_stage_to_detector = tick_cnt;
+	warm_requested = true;
+	suspended = false;
 }
 
 void face_tracker_manager::post_render()
 {
+	if (power_save && !is_active) {
+		if (!suspended)
+			suspend();
+		return;
+	}
+	if (suspended)
+		resume();
+
+	if (warm_requested)
+		warm_start();
+
 	stage_to_detector();
 	stage_to_trackers();
 }
 
+bool face_tracker_manager::is_frame_needed()
+{
+	// Called after post_render; tells whether the detector or any tracker will take a frame at the next post_render.
+	if (power_save && !is_active)
+		return false;
+	if (suspended || warm_requested)
+		return true;
+
+	if (detect && (detector_in_progress || (next_tick_stage_to_detector - (tick_cnt + 1)) <= 0)) {
+		if (!detect->trylock()) {
+			detect->unlock();
+			return true;
+		}
+	}
+
+	for (size_t i = 0; i < trackers.size(); i++) {
+		enum tracker_state_e state = trackers.state[i];
+		if (
+				state != tracker_state_constructing &&
+				state != tracker_state_first_track &&
+				state != tracker_state_available )
+			continue;
+		if (state == tracker_state_available && !is_tracking_due(i, second_last))
+			continue;
+		if (!trackers.tracker[i]->trylock()) {
+			trackers.tracker[i]->unlock();
+			return true;
+		}
+	}
+
+	return false;
+}
+
 static void update_detector(face_tracker_manager *ftm, enum face_tracker_manager::detector_engine_e detector_engine)
 {
 	if (ftm->detect) {
@@ -361,6 +665,9 @@ static void update_detector(face_tracker_manager *ftm, enum face_tracker_manager
 	case face_tracker_manager::engine_dlib_cnn:
 		ftm->detect = new face_detector_dlib_cnn();
 		break;
+	case face_tracker_manager::engine_dlib_hybrid:
+		ftm->detect = new face_detector_dlib_hybrid();
+		break;
 	default:
 		blog(LOG_ERROR, "unknown detector_engine %d", (int)detector_engine);
 	}
@@ -383,15 +690,23 @@ void face_tracker_manager::update(obs_data_t *settings)
 		update_detector(this, _detector_engine);
 	detector_dlib_hog_model = obs_data_get_string(settings, "detector_dlib_hog_model");
 	detector_dlib_cnn_model = obs_data_get_string(settings, "detector_dlib_cnn_model");
+	detector_hybrid_full_interval = obs_data_get_int(settings, "detector_hybrid_full_interval");
 	detector_crop_l = obs_data_get_int(settings, "detector_crop_l");
 	detector_crop_r = obs_data_get_int(settings, "detector_crop_r");
 	detector_crop_t = obs_data_get_int(settings, "detector_crop_t");
 	detector_crop_b = obs_data_get_int(settings, "detector_crop_b");
+	detector_score_th = obs_data_get_double(settings, "detector_score_th");
+	detector_nms_th = obs_data_get_double(settings, "detector_nms_th");
 	bool landmark_detection = obs_data_get_bool(settings, "landmark_detection");
 	bfree(landmark_detection_data);
 	landmark_detection_data = NULL;
 	if (landmark_detection)
 		landmark_detection_data = bstrdup(obs_data_get_string(settings, "landmark_detection_data"));
+	motion_prediction = obs_data_get_bool(settings, "motion_prediction");
+	tracking_rate = (float)obs_data_get_int(settings, "tracking_rate");
+	tracking_budget = obs_data_get_bool(settings, "tracking_budget");
+	tracking_latency_max = obs_data_get_int(settings, "tracking_latency_max") * 1e-3f;
+	power_save = obs_data_get_bool(settings, "power_save");
 	if (obs_data_get_bool(settings, "tracking_th_en"))
 		tracking_threshold = from_dB(obs_data_get_double(settings, "tracking_th_dB"));
 	else
@@ -406,6 +721,22 @@ static bool tracking_th_en_modified(obs_properties_t *props, obs_property_t *, o
 	return true;
 }
 
+static bool tracking_budget_modified(obs_properties_t *props, obs_property_t *, obs_data_t *settings)
+{
+	bool tracking_budget = obs_data_get_bool(settings, "tracking_budget");
+	obs_property_t *tracking_latency_max = obs_properties_get(props, "tracking_latency_max");
+	obs_property_set_visible(tracking_latency_max, tracking_budget);
+	return true;
+}
+
+static bool detector_engine_modified(obs_properties_t *props, obs_property_t *, obs_data_t *settings)
+{
+	auto detector_engine = (enum face_tracker_manager::detector_engine_e)obs_data_get_int(settings, "detector_engine");
+	obs_property_t *detector_hybrid_full_interval = obs_properties_get(props, "detector_hybrid_full_interval");
+	obs_property_set_visible(detector_hybrid_full_interval, detector_engine == face_tracker_manager::engine_dlib_hybrid);
+	return true;
+}
+
 void face_tracker_manager::get_properties(obs_properties_t *pp)
 {
 	obs_property_t *p;
@@ -420,14 +751,19 @@ void face_tracker_manager::get_properties(obs_properties_t *pp)
 			OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
 	obs_property_list_add_int(p, obs_module_text("Detector.dlib.hog"), (int)engine_dlib_hog);
 	obs_property_list_add_int(p, obs_module_text("Detector.dlib.cnn"), (int)engine_dlib_cnn);
+	obs_property_list_add_int(p, obs_module_text("Detector.dlib.hybrid"), (int)engine_dlib_hybrid);
+	obs_property_set_modified_callback(p, detector_engine_modified);
 	obs_properties_add_path(pp, "detector_dlib_hog_model", obs_module_text("Dlib HOG model"),
 			OBS_PATH_FILE, "Data Files (*.dat);;" "All Files (*.*)", (data_path + "/" DIR_DLIB_CNN).c_str() );
 	obs_properties_add_path(pp, "detector_dlib_cnn_model", obs_module_text("Dlib CNN model"),
 			OBS_PATH_FILE, "Data Files (*.dat);;" "All Files (*.*)", (data_path + "/" DIR_DLIB_CNN).c_str() );
+	obs_properties_add_int(pp, "detector_hybrid_full_interval", obs_module_text("Run CNN on the whole image every"), 1, 30, 1);
 	obs_properties_add_int(pp, "detector_crop_l", obs_module_text("Crop left for detector"), 0, 1920, 1);
 	obs_properties_add_int(pp, "detector_crop_r", obs_module_text("Crop right for detector"), 0, 1920, 1);
 	obs_properties_add_int(pp, "detector_crop_t", obs_module_text("Crop top for detector"), 0, 1080, 1);
 	obs_properties_add_int(pp, "detector_crop_b", obs_module_text("Crop bottom for detector"), 0, 1080, 1);
+	obs_properties_add_float(pp, "detector_score_th", obs_module_text("Minimum detection score"), 0.0, 3.0, 0.05);
+	obs_properties_add_float(pp, "detector_nms_th", obs_module_text("Overlap threshold for detections"), 0.1, 1.0, 0.05);
 	obs_properties_add_bool(pp, "landmark_detection", obs_module_text("Enable landmark detection"));
 	p = obs_properties_add_path(pp, "landmark_detection_data", obs_module_text("Landmark detection data"),
 			OBS_PATH_FILE,
@@ -441,6 +777,23 @@ void face_tracker_manager::get_properties(obs_properties_t *pp)
 	obs_property_set_modified_callback(p, tracking_th_en_modified);
 	p = obs_properties_add_float(pp, "tracking_th_dB", obs_module_text("Tracking threshold"), -120.0, -20.0, 5.0);
 	obs_property_float_set_suffix(p, " dB");
+	p = obs_properties_add_bool(pp, "motion_prediction", obs_module_text("Predict face motion"));
+	obs_property_set_long_description(p, obs_module_text(
+				"Extrapolate the tracked faces to the current frame "
+				"so that the delay of the tracker does not delay the framing." ));
+	p = obs_properties_add_list(pp, "tracking_rate", obs_module_text("Tracking rate"),
+			OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(p, obs_module_text("Every frame"), 0);
+	obs_property_list_add_int(p, obs_module_text("60 Hz"), 60);
+	obs_property_list_add_int(p, obs_module_text("30 Hz"), 30);
+	obs_property_list_add_int(p, obs_module_text("15 Hz"), 15);
+	p = obs_properties_add_bool(pp, "tracking_budget", obs_module_text("Lower tracking rate when tracking is slow"));
+	obs_property_set_modified_callback(p, tracking_budget_modified);
+	p = obs_properties_add_int(pp, "tracking_latency_max", obs_module_text("Maximum tracking latency"), 5, 500, 1);
+	obs_property_int_set_suffix(p, " ms");
+	p = obs_properties_add_bool(pp, "power_save", obs_module_text("Pause while not shown"));
+	obs_property_set_long_description(p, obs_module_text(
+				"Stop detecting and tracking faces while the source is neither on the program nor on the preview." ));
 }
 
 void face_tracker_manager::get_defaults(obs_data_t *settings)
@@ -450,8 +803,16 @@ void face_tracker_manager::get_defaults(obs_data_t *settings)
 	obs_data_set_default_double(settings, "upsize_t", 0.3);
 	obs_data_set_default_double(settings, "upsize_b", 0.1);
 	obs_data_set_default_double(settings, "scale", 2.0);
+	obs_data_set_default_int(settings, "detector_hybrid_full_interval", 5);
+	obs_data_set_default_double(settings, "detector_score_th", 0.0);
+	obs_data_set_default_double(settings, "detector_nms_th", 0.5);
 	obs_data_set_default_bool(settings, "tracking_th_en", true);
 	obs_data_set_default_double(settings, "tracking_th_dB", -80.0);
+	obs_data_set_default_bool(settings, "motion_prediction", false);
+	obs_data_set_default_int(settings, "tracking_rate", 0);
+	obs_data_set_default_bool(settings, "tracking_budget", false);
+	obs_data_set_default_int(settings, "tracking_latency_max", 33);
+	obs_data_set_default_bool(settings, "power_save", false);
 
 	if (char *f = obs_module_file(DIR_DLIB_HOG "/frontal_face_detector.dat")) {
 		obs_data_set_default_string(settings, "detector_dlib_hog_model", f);
@@ -1,8 +1,10 @@
 #pragma once
 
-#include <deque>
 #include <string>
+#include <vector>
 #include "face-tracker-base.h"
+#include "rect-grid.hpp"
+#include "motion-model.hpp"
 
 class face_tracker_manager
 {
@@ -10,33 +12,68 @@ class face_tracker_manager
 		enum detector_engine_e {
 			engine_dlib_hog = 0,
 			engine_dlib_cnn = 1,
+			engine_dlib_hybrid = 2,
 			engine_uninitialized = -1,
 		};
 
 		struct tracker_rect_s {
 			rect_s rect;
 			rectf_s crop_rect;
-			std::vector<pointf_s> landmark;
+			pointf_span_s landmark;
 		};
 
-		struct tracker_inst_s
+		/*
+		 * Tracking results of one tick.
+		 * The buffers keep their capacity so that filling them won't allocate in a steady state.
+		 */
+		struct tracker_rects_s
 		{
-			class face_tracker_base *tracker;
-			rect_s rect;
-			rectf_s crop_tracker; // crop corresponding to current processing image
-			rectf_s crop_rect; // crop corresponding to rect
-			std::vector<pointf_s> landmark;
-			float att;
-			float score_first;
-			enum tracker_state_e {
-				tracker_state_init = 0,
-				tracker_state_reset_texture, // texture has been set, position is not set.
-				tracker_state_constructing, // texture and positions have been set, starting to construct correlation_tracker.
-				tracker_state_first_track, // correlation_tracker has been prepared, running 1st tracking
-				tracker_state_available, // 1st tracking was done, `rect` is available, can accept next frame.
-				tracker_state_ending,
-			} state;
-			int tick_cnt;
+			std::vector<tracker_rect_s> rects;
+			std::vector<pointf_s> landmark; // `rects[i].landmark` points here
+			size_t n = 0;
+
+			size_t size() const { return n; }
+			const tracker_rect_s &operator[](size_t i) const { return rects[i]; }
+		};
+
+		enum tracker_state_e {
+			tracker_state_init = 0,
+			tracker_state_constructing, // texture and positions have been set, starting to construct correlation_tracker.
+			tracker_state_first_track, // correlation_tracker has been prepared, running 1st tracking
+			tracker_state_available, // 1st tracking was done, `rect` is available, can accept next frame.
+			tracker_state_ending,
+		};
+
+		/*
+		 * Running trackers in structure-of-arrays.
+		 * Index i of each array belongs to the same tracker.
+		 * Removing a tracker moves the last tracker to its index.
+		 */
+		struct tracker_table_s
+		{
+			std::vector<class face_tracker_base *> tracker;
+			std::vector<rect_s> rect;
+			std::vector<rectf_s> crop_tracker; // crop corresponding to current processing image
+			std::vector<rectf_s> crop_rect; // crop corresponding to rect
+			std::vector<float> att;
+			std::vector<float> score_first;
+			std::vector<enum tracker_state_e> state;
+			std::vector<int> tick_cnt;
+			std::vector<int> tick_tracker; // tick of the current processing image
+			std::vector<int> tick_rect; // tick corresponding to rect
+			std::vector<motion_model> motion;
+			std::vector<float> time_staged; // time when the current processing image was staged
+			std::vector<bool> warm; // started from the last known box, not verified by the detector yet
+			std::vector<uint32_t> seq; // smaller is older
+			std::vector<int> n_landmark;
+			std::vector<pointf_s> landmark; // n_landmark[i] points from landmark[i * landmark_stride]
+			size_t landmark_stride = 0;
+
+			size_t size() const { return tracker.size(); }
+			size_t add(class face_tracker_base *t);
+			void remove(size_t i);
+			const pointf_s *get_landmark(size_t i) const { return landmark.data() + i * landmark_stride; }
+			void set_landmark(size_t i, const std::vector<pointf_s> &lm);
 		};
 
 	public: // properties
@@ -44,37 +81,73 @@ class face_tracker_manager
 		volatile float scale;
 		volatile bool reset_requested;
 		float tracking_threshold;
+		bool motion_prediction;
+		float tracking_rate; // Hz, 0 for every frame
+		bool tracking_budget;
+		float tracking_latency_max; // second
+		bool power_save;
 		enum detector_engine_e detector_engine = engine_uninitialized;
 		std::string detector_dlib_hog_model;
 		std::string detector_dlib_cnn_model;
+		int detector_hybrid_full_interval;
 		int detector_crop_l, detector_crop_r, detector_crop_t, detector_crop_b;
+		float detector_score_th;
+		float detector_nms_th;
 		char *landmark_detection_data;
 
 	public: // realtime status
 		rectf_s crop_cur;
 		int tick_cnt;
+		float tracking_rate_eff; // Hz, the rate limit currently applied
+		float tracking_rate_measured; // Hz, average number of updates for each tracker
+		float tracking_latency; // second, averaged processing time of the trackers
+		float detect_latency; // second, processing time of the last detection
+		volatile bool is_active; // shown on the program or the preview, set by the owner
+		bool drives_camera; // the results move a camera even while not shown, set by the owner
+
+	public: // set by face_tracker_scheduler
+		float sched_rate_limit; // Hz, 0 for no limit
+		float detect_interval; // second
 
 	public: // results
 		std::vector<rect_s> detect_rects;
-		std::vector<tracker_rect_s> tracker_rects;
+		const tracker_rects_s *tracker_rects; // flipped at each tick, stays unchanged until the next tick
 
 	public: /* not sure they are necessary to be public */
 		class face_detector_base *detect;
 		int detect_tick;
 
-		// TODO: Just have two pairs
-		std::deque<struct tracker_inst_s> trackers;
-		std::deque<struct tracker_inst_s> trackers_idlepool;
+		struct tracker_table_s trackers;
+		std::vector<class face_tracker_base *> trackers_idlepool;
 
 	private:
 		int next_tick_stage_to_detector;
 		bool detector_in_progress;
+		std::shared_ptr<texture_object> detect_cvtex;
+		rectf_s detect_crop;
+		tracker_rects_s tracker_rects_buf[2];
+		rect_grid grid;
+		std::vector<int> grid_hits;
+		std::vector<bool> to_remove;
+		std::vector<pointf_s> landmark_tmp;
+		uint32_t tracker_seq;
+		float time_cur;
+		float time_window;
+		float second_last;
+		int n_results_window;
+		bool suspended;
+		std::vector<rect_s> warm_rects; // last known boxes to restart tracking
+		bool warm_requested;
+		bool detect_local; // next detection is only around the warm boxes
+		bool detect_local_in_progress;
+		int local_crop_l, local_crop_r, local_crop_t, local_crop_b;
 
 	public:
 		face_tracker_manager();
 		virtual ~face_tracker_manager();
 		void tick(float second);
 		void post_render();
+		bool is_frame_needed();
 		void update(obs_data_t *settings);
 		static void get_properties(obs_properties_t *);
 		static void get_defaults(obs_data_t *settings);
@@ -84,11 +157,30 @@ class face_tracker_manager
 
 	private:
 		inline void retire_tracker(int ix);
-		inline bool is_low_confident(const tracker_inst_s &t, float th1);
+		inline class face_tracker_base *get_idle_tracker();
+		inline bool is_low_confident(size_t i, float th1);
+		void filter_detections();
 		void remove_duplicated_tracker();
 		void attenuate_tracker();
 		void copy_detector_to_tracker();
 		void stage_to_detector();
-		int stage_surface_to_tracker(struct tracker_inst_s &t);
+		int stage_surface_to_tracker(size_t i);
+		inline bool is_tracking_due(size_t i, float ahead = 0.0f) const;
+		void update_tracking_rate(float second);
+		void suspend();
+		void resume();
+		void save_warm_rects();
+		void warm_start();
+		void verify_warm_trackers();
+		void start_tracker(const rect_s &r, std::shared_ptr<texture_object> &cvtex, const rectf_s &crop, int tick);
 		void stage_to_trackers();
 };
+
+/*
+ * Fills the tracking results from the available trackers.
+ * The boxes are predicted to `tick_cnt` if `motion_prediction` is set.
+ */
+void make_tracker_rects(
+		face_tracker_manager::tracker_rects_s &tracker_rects,
+		const face_tracker_manager::tracker_table_s &trackers,
+		bool motion_prediction, int tick_cnt, const rectf_s &crop_cur );
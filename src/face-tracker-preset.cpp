@@ -10,6 +10,20 @@ static void copy_data_double(obs_data_t *dst, obs_data_t *src, const char *name)
 	obs_data_set_double(dst, name, v);
 }
 
+static void copy_data_int(obs_data_t *dst, obs_data_t *src, const char *name)
+{
+	blog(LOG_INFO, "copying %s as int", name);
+	long long v = obs_data_get_int(src, name);
+	obs_data_set_int(dst, name, v);
+}
+
+static void copy_data_bool(obs_data_t *dst, obs_data_t *src, const char *name)
+{
+	blog(LOG_INFO, "copying %s as bool", name);
+	bool v = obs_data_get_bool(src, name);
+	obs_data_set_bool(dst, name, v);
+}
+
 #define preset_mask_track 1
 #define preset_mask_control 2
 static const struct {
@@ -63,6 +77,12 @@ static const struct {
 	{ "Td_z",            copy_data_double, preset_mask_control },
 	{ "Tdlpf_z",         copy_data_double, preset_mask_control },
 	{ "Tatt_int",        copy_data_double, preset_mask_control },
+	{ "latency_compensation", copy_data_bool, preset_mask_control },
+	{ "latency_ms",      copy_data_double, preset_mask_control },
+	{ "control_mode",    copy_data_int,    preset_mask_control },
+	{ "pos_pan_per_width",   copy_data_int,    preset_mask_control },
+	{ "pos_tilt_per_height", copy_data_int,    preset_mask_control },
+	{ "pos_gain",        copy_data_double, preset_mask_control },
 	{ NULL, NULL, 0 }
 };
 
@@ -6,6 +6,7 @@
 #include "plugin-macros.generated.h"
 #include "texture-object.h"
 #include <algorithm>
+#include <string>
 #include <graphics/matrix4.h>
 #include <media-io/video-scaler.h>
 #include "helper.hpp"
@@ -13,9 +14,11 @@
 #include "face-tracker-preset.h"
 #include "face-tracker-manager.hpp"
 #include "ptz-backend.hpp"
+#include "ptz-shared-backend.hpp"
 #include "obsptz-backend.hpp"
 #ifdef WITH_PTZ_TCP
 #include "libvisca-thread.hpp"
+#include "visca-udp-backend.hpp"
 #endif
 #include "dummy-backend.hpp"
 
@@ -23,25 +26,29 @@
 #define PTZ_MAX_Y 0x14
 #define PTZ_MAX_Z 0x07
 
-enum ptz_cmd_state_e
+enum ptz_control_mode_e
 {
-	ptz_cmd_state_none = 0,
-	ptz_cmd_state_pantilt,
-	ptz_cmd_state_zoom,
+	ptz_control_mode_speed = 0,
+	ptz_control_mode_position = 1,
 };
 
+#define ZOOM_RAW_MAX 16384
+
+static std::shared_ptr<texture_object> frame_to_cvtex(struct face_tracker_ptz *s, struct obs_source_frame *frame);
+
 class ft_manager_for_ftptz : public face_tracker_manager
 {
 	public:
 		struct face_tracker_ptz *ctx;
 		std::shared_ptr<texture_object> cvtex_cache;
-		enum ptz_cmd_state_e ptz_last_cmd;
+		struct obs_source_frame *frame_cur; // available only inside post_render
 		class ptz_backend *dev;
 
 	public:
 		ft_manager_for_ftptz(struct face_tracker_ptz *ctx_) {
 			ctx = ctx_;
 			cvtex_cache = NULL;
+			frame_cur = NULL;
 			dev = NULL;
 		}
 
@@ -68,6 +75,9 @@ class ft_manager_for_ftptz : public face_tracker_manager
 
 		std::shared_ptr<texture_object> get_cvtex() override
 		{
+			// Copy the frame only if the detector or a tracker takes it.
+			if (!cvtex_cache && frame_cur)
+				cvtex_cache = frame_to_cvtex(ctx, frame_cur);
 			return cvtex_cache;
 		};
 };
@@ -95,13 +105,14 @@ struct ptz_copy_setting_item_s
 	void (*copy)(obs_data_t *, const char *, obs_data_t *, const char *);
 };
 
-static void ptz_copy_settings(obs_data_t *data, obs_data_t *settings, const struct ptz_copy_setting_item_s *list)
+static void ptz_copy_settings(obs_data_t *data, obs_data_t *settings, const struct ptz_copy_setting_item_s *list, const char *prefix)
 {
 	for (int i=0; list[i].dst; i++)
-		list[i].copy(data, list[i].dst, settings, list[i].src);
+		list[i].copy(data, list[i].dst, settings, (std::string(prefix) + list[i].src).c_str());
 }
 
-static obs_data_t *get_ptz_settings(obs_data_t *settings)
+// `prefix` selects the settings of a follower camera, which are named like the settings of the main camera.
+static obs_data_t *get_ptz_settings(obs_data_t *settings, const char *prefix = "")
 {
 	obs_data_t *data = obs_data_create();
 
@@ -118,50 +129,64 @@ static obs_data_t *get_ptz_settings(obs_data_t *settings)
 	const struct ptz_copy_setting_item_s list_viscaip[] = {
 		{"address", "ptz-viscaip-address", copy_string},
 		{"port", "ptz-viscaip-port", copy_int},
+		{"zoom_poll_ms", "ptz-viscaip-zoom_poll_ms", copy_int},
 		{NULL, NULL, NULL}
 	};
 
-	ptz_copy_settings(data, settings, list_generic);
+	const struct ptz_copy_setting_item_s list_viscaudp[] = {
+		{"address", "ptz-viscaip-address", copy_string},
+		{"port", "ptz-viscaudp-port", copy_int},
+		{"zoom_poll_ms", "ptz-viscaip-zoom_poll_ms", copy_int},
+		{NULL, NULL, NULL}
+	};
+
+	ptz_copy_settings(data, settings, list_generic, prefix);
 
 	const char *type = obs_data_get_string(data, "type");
 	if (!strcmp(type, "visca-over-tcp"))
-		ptz_copy_settings(data, settings, list_viscaip);
+		ptz_copy_settings(data, settings, list_viscaip, prefix);
+	else if (!strcmp(type, "visca-over-udp"))
+		ptz_copy_settings(data, settings, list_viscaudp, prefix);
 	else if (!strcmp(type, "obsptz"))
-		ptz_copy_settings(data, settings, list_obsptz);
+		ptz_copy_settings(data, settings, list_obsptz, prefix);
 
 	return data;
 }
 
-static void make_deice_obsptz(struct face_tracker_ptz *s, obs_data_t *data)
+// Returns a new backend for the type or NULL if the type is unknown or the settings are insufficient.
+static class ptz_backend *make_device(const char *ptz_type, obs_data_t *data)
 {
-	s->ftm->release_dev();
-
-	s->ftm->dev = new obsptz_backend();
-	s->ftm->dev->set_config(data);
-}
+	class ptz_backend *dev = NULL;
 
+	if (!strcmp(ptz_type, "obsptz")) {
+		dev = new obsptz_backend();
+	}
 #ifdef WITH_PTZ_TCP
-static void make_device_libvisca_tcp(struct face_tracker_ptz *s, obs_data_t *data)
-{
-	s->ftm->release_dev();
-
-	if (!obs_data_get_string(data, "address"))
-		return;
-	if (obs_data_get_int(data, "port") <= 0)
-		return;
-	s->ftm->dev = new libvisca_thread();
-	s->ftm->dev->set_config(data);
-}
+	else if (!strcmp(ptz_type, "visca-over-tcp") || !strcmp(ptz_type, "visca-over-udp")) {
+		if (!obs_data_get_string(data, "address"))
+			return NULL;
+		if (obs_data_get_int(data, "port") <= 0)
+			return NULL;
+		// Share the connection with the other filters addressing the same camera.
+		if (!strcmp(ptz_type, "visca-over-tcp"))
+			dev = new ptz_shared_backend(ptz_type, []() -> class ptz_backend * { return new libvisca_thread(); });
+		else
+			dev = new ptz_shared_backend(ptz_type, []() -> class ptz_backend * { return new visca_udp_backend(); });
+	}
 #endif // WITH_PTZ_TCP
+	else if (!strcmp(ptz_type, "dummy")) {
+		return new dummy_backend();
+	}
+	else {
+		return NULL;
+	}
 
-static void make_device_dummy(struct face_tracker_ptz *s, obs_data_t *data)
-{
-	s->ftm->release_dev();
-
-	s->ftm->dev = new dummy_backend();
-	UNUSED_PARAMETER(data);
+	dev->set_config(data);
+	return dev;
 }
 
+static void update_followers(struct face_tracker_ptz *s, obs_data_t *settings);
+
 static void ftptz_update(void *data, obs_data_t *settings)
 {
 	auto *s = (struct face_tracker_ptz*)data;
@@ -194,6 +219,14 @@ static void ftptz_update(void *data, obs_data_t *settings)
 	s->e_nonlinear.v[2] = (float)obs_data_get_double(settings, "e_nonlinear_z") * 1e-2;
 	float Tatt_int = (float)obs_data_get_double(settings, "Tatt_int");
 	s->f_att_int = Tatt_int > 0.0f ? 1.0f / Tatt_int : 1e3;
+	s->latency_compensation = obs_data_get_bool(settings, "latency_compensation");
+	s->latency_fixed = (float)(obs_data_get_double(settings, "latency_ms") * 1e-3);
+	s->control_mode = (int)obs_data_get_int(settings, "control_mode");
+	s->pos_pan_per_width = (int)obs_data_get_int(settings, "pos_pan_per_width");
+	s->pos_tilt_per_height = (int)obs_data_get_int(settings, "pos_tilt_per_height");
+	s->pos_gain = (float)obs_data_get_double(settings, "pos_gain");
+	if (s->control_mode != ptz_control_mode_position)
+		s->ptz_target_sent = false;
 
 	s->face_lost_preset_timeout_ms = (int)(obs_data_get_double(settings, "face_lost_preset_timeout") * 1e3);
 	s->face_lost_ptz_preset = (int)obs_data_get_int(settings, "face_lost_ptz_preset");
@@ -215,21 +248,9 @@ static void ftptz_update(void *data, obs_data_t *settings)
 	if (!s->ptz_type || strcmp(ptz_type, s->ptz_type)) {
 		obs_data_t *data = get_ptz_settings(settings);
 
-		if (!strcmp(ptz_type, "obsptz")) {
-			make_deice_obsptz(s, data);
-		}
-#ifdef WITH_PTZ_TCP
-		else if (!strcmp(ptz_type, "visca-over-tcp")) {
-			make_device_libvisca_tcp(s, data);
-		}
-#endif // WITH_PTZ_TCP
-		else if (!strcmp(ptz_type, "dummy")) {
-			make_device_dummy(s, data);
-		}
-		else if (s->ftm->dev) {
-			s->ftm->dev->release();
-			s->ftm->dev = NULL;
-		}
+		s->ftm->release_dev();
+		s->ftm->dev = make_device(ptz_type, data);
+		s->delay_cmd_sent[0] = s->delay_cmd_sent[1] = 0.0f; // release_dev has stopped the camera
 		bfree(s->ptz_type);
 		s->ptz_type = bstrdup(ptz_type);
 		obs_data_release(data);
@@ -240,6 +261,56 @@ static void ftptz_update(void *data, obs_data_t *settings)
 			s->ftm->dev->set_config(data);
 		obs_data_release(data);
 	}
+
+	update_followers(s, settings);
+}
+
+// The name of the checkable group, which also enables the follower.
+static std::string follower_group(int i)
+{
+	return "follower" + std::to_string(i + 1);
+}
+
+static std::string follower_prefix(int i)
+{
+	return follower_group(i) + "-";
+}
+
+static void update_followers(struct face_tracker_ptz *s, obs_data_t *settings)
+{
+	for (int i=0; i<FTPTZ_N_FOLLOWERS; i++) {
+		struct ftptz_follower_s *f = &s->followers[i];
+		const std::string prefix = follower_prefix(i);
+		auto key = [&prefix](const char *name) { return prefix + name; };
+
+		f->pan_center = (int)obs_data_get_int(settings, key("pan_center").c_str());
+		f->tilt_center = (int)obs_data_get_int(settings, key("tilt_center").c_str());
+		f->pan_per_width = (int)obs_data_get_int(settings, key("pan_per_width").c_str());
+		f->tilt_per_height = (int)obs_data_get_int(settings, key("tilt_per_height").c_str());
+		int zoom = (int)obs_data_get_int(settings, key("zoom").c_str());
+		if (zoom != f->zoom)
+			f->zoom_sent = false;
+		f->zoom = zoom;
+		f->target_sent = false;
+
+		const char *ptz_type = "dummy";
+		if (obs_data_get_bool(settings, follower_group(i).c_str()))
+			ptz_type = obs_data_get_string(settings, key("ptz-type").c_str());
+
+		obs_data_t *data = get_ptz_settings(settings, prefix.c_str());
+		if (!f->ptz_type || strcmp(ptz_type, f->ptz_type)) {
+			if (f->dev)
+				f->dev->release();
+			f->dev = strcmp(ptz_type, "dummy") ? make_device(ptz_type, data) : NULL;
+			f->zoom_sent = false;
+			bfree(f->ptz_type);
+			f->ptz_type = bstrdup(ptz_type);
+		}
+		else if (f->dev) {
+			f->dev->set_config(data);
+		}
+		obs_data_release(data);
+	}
 }
 
 static void cb_render_info(void *data, calldata_t *cd);
@@ -256,10 +327,18 @@ static void *ftptz_create(obs_data_t *settings, obs_source_t *context)
 	auto *s = (struct face_tracker_ptz*)bzalloc(sizeof(struct face_tracker_ptz));
 	s->ftm = new ft_manager_for_ftptz(s);
 	s->ftm->crop_cur.x1 = s->ftm->crop_cur.y1 = -2;
+	s->ftm->is_active = false;
+	s->ftm->drives_camera = true;
 	s->context = context;
 	s->ftm->scale = 2.0f;
 	s->hotkey_pause = OBS_INVALID_HOTKEY_PAIR_ID;
 	s->hotkey_reset = OBS_INVALID_HOTKEY_ID;
+	for (int i=0; i<2; i++) {
+		s->delay_est[i].reset();
+		s->delay_cmd[i] = 0.0f;
+		s->delay_cmd_sent[i] = 0.0f;
+		s->latency_ticks[i] = -1;
+	}
 
 	obs_source_update(context, settings);
 
@@ -285,6 +364,11 @@ static void ftptz_destroy(void *data)
 
 	delete s->ftm;
 	bfree(s->ptz_type);
+	for (int i=0; i<FTPTZ_N_FOLLOWERS; i++) {
+		if (s->followers[i].dev)
+			s->followers[i].dev->release();
+		bfree(s->followers[i].ptz_type);
+	}
 	if (s->debug_data_tracker)
 		fclose(s->debug_data_tracker);
 	if (s->debug_data_error)
@@ -321,6 +405,21 @@ static void set_properties_visible(obs_properties_t *props, const char **names,
 	}
 }
 
+static bool control_mode_modified(obs_properties_t *props, obs_property_t *, obs_data_t *settings)
+{
+	const bool position = obs_data_get_int(settings, "control_mode") == ptz_control_mode_position;
+
+	const char *props_position[] = {
+		"pos_pan_per_width",
+		"pos_tilt_per_height",
+		"pos_gain",
+		NULL
+	};
+	set_properties_visible(props, props_position, position);
+
+	return true;
+}
+
 static bool ptz_type_modified(obs_properties_t *props, obs_property_t *, obs_data_t *settings)
 {
 	const char *ptz_type = obs_data_get_string(settings, "ptz-type");
@@ -333,19 +432,114 @@ static bool ptz_type_modified(obs_properties_t *props, obs_property_t *, obs_dat
 
 	const char *props_viscaip[] = {
 		"ptz-viscaip-address",
+		"ptz-viscaip-zoom_poll_ms",
+		NULL
+	};
+	const char *props_viscatcp[] = {
 		"ptz-viscaip-port",
 		NULL
 	};
-	bool en = false;
+	const char *props_viscaudp[] = {
+		"ptz-viscaudp-port",
+		NULL
+	};
+	bool en_tcp = false, en_udp = false;
 #ifdef WITH_PTZ_TCP
 	if (!strcmp(ptz_type, "visca-over-tcp"))
-		en = true;
+		en_tcp = true;
+	if (!strcmp(ptz_type, "visca-over-udp"))
+		en_udp = true;
 #endif // WITH_PTZ_TCP
+	set_properties_visible(props, props_viscatcp, en_tcp);
+	set_properties_visible(props, props_viscaudp, en_udp);
+	const bool en = en_tcp || en_udp;
 	set_properties_visible(props, props_viscaip, en);
 
 	return true;
 }
 
+// Returns the index of the follower from the name of its property, or -1.
+static int follower_index(const char *name)
+{
+	for (int i=0; i<FTPTZ_N_FOLLOWERS; i++) {
+		const std::string prefix = follower_prefix(i);
+		if (!strncmp(name, prefix.c_str(), prefix.size()))
+			return i;
+	}
+	return -1;
+}
+
+static bool follower_ptz_type_modified(obs_properties_t *props, obs_property_t *p, obs_data_t *settings)
+{
+	int i = follower_index(obs_property_name(p));
+	if (i < 0)
+		return false;
+	const std::string prefix = follower_prefix(i);
+	const char *ptz_type = obs_data_get_string(settings, (prefix + "ptz-type").c_str());
+	const bool en_tcp = !strcmp(ptz_type, "visca-over-tcp");
+	const bool en_udp = !strcmp(ptz_type, "visca-over-udp");
+
+	const char *names_viscaip[] = {"ptz-viscaip-address", "ptz-viscaip-zoom_poll_ms", "calibrate_center", "calibrate_corner", NULL};
+	for (int k=0; names_viscaip[k]; k++) {
+		obs_property_t *prop = obs_properties_get(props, (prefix + names_viscaip[k]).c_str());
+		if (prop) obs_property_set_visible(prop, en_tcp || en_udp);
+	}
+	obs_property_t *prop = obs_properties_get(props, (prefix + "ptz-viscaip-port").c_str());
+	if (prop) obs_property_set_visible(prop, en_tcp);
+	prop = obs_properties_get(props, (prefix + "ptz-viscaudp-port").c_str());
+	if (prop) obs_property_set_visible(prop, en_udp);
+
+	return true;
+}
+
+/*
+ * Calibration of a follower
+ * Point the follower at the object that appears at the center of the image, then press the button for the center.
+ * Point it at the object at the bottom-right corner, then press the button for the corner.
+ */
+static bool follower_calibrate(void *data, obs_property_t *p, bool corner)
+{
+	auto *s = (struct face_tracker_ptz*)data;
+	int i = follower_index(obs_property_name(p));
+	if (i < 0 || !s->followers[i].dev)
+		return false;
+
+	int pan, tilt;
+	if (!s->followers[i].dev->get_position(pan, tilt)) {
+		// The backend starts to inquire the position now.
+		blog(LOG_WARNING, "[%s] follower %d: position is not available yet, try again",
+				obs_source_get_name(s->context), i + 1);
+		return false;
+	}
+
+	const std::string prefix = follower_prefix(i);
+	obs_data_t *settings = obs_source_get_settings(s->context);
+	if (!corner) {
+		obs_data_set_int(settings, (prefix + "pan_center").c_str(), pan);
+		obs_data_set_int(settings, (prefix + "tilt_center").c_str(), tilt);
+	}
+	else {
+		const int pan_center = (int)obs_data_get_int(settings, (prefix + "pan_center").c_str());
+		const int tilt_center = (int)obs_data_get_int(settings, (prefix + "tilt_center").c_str());
+		obs_data_set_int(settings, (prefix + "pan_per_width").c_str(), (pan - pan_center) * 2);
+		obs_data_set_int(settings, (prefix + "tilt_per_height").c_str(), (tilt_center - tilt) * 2);
+	}
+	obs_source_update(s->context, settings);
+	obs_data_release(settings);
+
+	return true;
+}
+
+static bool follower_calibrate_center(obs_properties_t *, obs_property_t *p, void *data)
+{
+	return follower_calibrate(data, p, false);
+}
+
+static bool follower_calibrate_corner(obs_properties_t *, obs_property_t *p, void *data)
+{
+	return follower_calibrate(data, p, true);
+}
+
 static obs_properties_t *ftptz_properties(void *data)
 {
 	auto *s = (struct face_tracker_ptz*)data;
@@ -387,6 +581,13 @@ static obs_properties_t *ftptz_properties(void *data)
 	{
 		obs_properties_t *pp = obs_properties_create();
 		obs_property_t *p;
+		p = obs_properties_add_list(pp, "control_mode", obs_module_text("Control mode"), OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+		obs_property_list_add_int(p, obs_module_text("Speed"), ptz_control_mode_speed);
+		obs_property_list_add_int(p, obs_module_text("Position"), ptz_control_mode_position);
+		obs_property_set_modified_callback(p, control_mode_modified);
+		obs_properties_add_int(pp, "pos_pan_per_width", obs_module_text("Pan steps across the image at wide end"), 1, 65535, 1);
+		obs_properties_add_int(pp, "pos_tilt_per_height", obs_module_text("Tilt steps across the image at wide end"), 1, 65535, 1);
+		obs_properties_add_float(pp, "pos_gain", obs_module_text("Position gain"), 0.05, 1.0, 0.05);
 		p = obs_properties_add_float(pp, "Kp_x_db", "Track Kp (X)",  -40.0, +80.0, 1.0);
 		obs_property_float_set_suffix(p, " dB");
 		p = obs_properties_add_float(pp, "Kp_y_db", "Track Kp (Y)", -40.0, +80.0, 1.0);
@@ -408,6 +609,9 @@ static obs_properties_t *ftptz_properties(void *data)
 		obs_properties_add_float(pp, "e_nonlinear_y", "Nonlinear band (Y)", 0.0, 50, 0.1);
 		obs_properties_add_float(pp, "e_nonlinear_z", "Nonlinear band (Z)", 0.0, 50, 0.1);
 		obs_properties_add_float(pp, "Tatt_int", "Attenuation time for lost face", 0.0, 4.0, 0.5);
+		obs_properties_add_bool(pp, "latency_compensation", obs_module_text("Compensate latency"));
+		p = obs_properties_add_float(pp, "latency_ms", obs_module_text("Latency (0 to estimate)"), 0.0, 1000.0, 10.0);
+		obs_property_float_set_suffix(p, " ms");
 		obs_properties_add_group(props, "ctrl", obs_module_text("Tracking response"), OBS_GROUP_NORMAL, pp);
 	}
 
@@ -429,11 +633,15 @@ static obs_properties_t *ftptz_properties(void *data)
 		obs_property_list_add_string(p, obs_module_text("through PTZ Controls"), "obsptz");
 #ifdef WITH_PTZ_TCP
 		obs_property_list_add_string(p, obs_module_text("VISCA over TCP"), "visca-over-tcp");
+		obs_property_list_add_string(p, obs_module_text("VISCA over IP (UDP)"), "visca-over-udp");
 #endif // WITH_PTZ_TCP
 		obs_property_set_modified_callback(p, ptz_type_modified);
 		obs_properties_add_int(pp, "ptz-obsptz-device_id", obs_module_text("Device ID"), 0, 99, 1);
 		obs_properties_add_text(pp, "ptz-viscaip-address", obs_module_text("IP address"), OBS_TEXT_DEFAULT);
 		obs_properties_add_int(pp, "ptz-viscaip-port", obs_module_text("Port"), 1, 65535, 1);
+		obs_properties_add_int(pp, "ptz-viscaudp-port", obs_module_text("Port"), 1, 65535, 1);
+		p = obs_properties_add_int(pp, "ptz-viscaip-zoom_poll_ms", obs_module_text("Zoom polling interval"), 20, 1000, 10);
+		obs_property_int_set_suffix(p, " ms");
 		obs_properties_add_int_slider(pp, "ptz_max_x", "Max control (pan)",  0, PTZ_MAX_X, 1);
 		obs_properties_add_int_slider(pp, "ptz_max_y", "Max control (tilt)", 0, PTZ_MAX_Y, 1);
 		obs_properties_add_int_slider(pp, "ptz_max_z", "Max control (zoom)", 0, PTZ_MAX_Z, 1);
@@ -443,6 +651,32 @@ static obs_properties_t *ftptz_properties(void *data)
 		obs_properties_add_group(props, "output", obs_module_text("Output"), OBS_GROUP_NORMAL, pp);
 	}
 
+#ifdef WITH_PTZ_TCP
+	for (int i=0; i<FTPTZ_N_FOLLOWERS; i++) {
+		const std::string prefix = follower_prefix(i);
+		auto name = [&prefix](const char *n) { return prefix + n; };
+		obs_properties_t *pp = obs_properties_create();
+		obs_property_t *p = obs_properties_add_list(pp, name("ptz-type").c_str(), obs_module_text("PTZ Type"), OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
+		obs_property_list_add_string(p, obs_module_text("VISCA over TCP"), "visca-over-tcp");
+		obs_property_list_add_string(p, obs_module_text("VISCA over IP (UDP)"), "visca-over-udp");
+		obs_property_set_modified_callback(p, follower_ptz_type_modified);
+		obs_properties_add_text(pp, name("ptz-viscaip-address").c_str(), obs_module_text("IP address"), OBS_TEXT_DEFAULT);
+		obs_properties_add_int(pp, name("ptz-viscaip-port").c_str(), obs_module_text("Port"), 1, 65535, 1);
+		obs_properties_add_int(pp, name("ptz-viscaudp-port").c_str(), obs_module_text("Port"), 1, 65535, 1);
+		p = obs_properties_add_int(pp, name("ptz-viscaip-zoom_poll_ms").c_str(), obs_module_text("Zoom polling interval"), 20, 1000, 10);
+		obs_property_int_set_suffix(p, " ms");
+		obs_properties_add_int(pp, name("pan_center").c_str(), obs_module_text("Pan at the center"), -0x8000, 0x7FFF, 1);
+		obs_properties_add_int(pp, name("tilt_center").c_str(), obs_module_text("Tilt at the center"), -0x8000, 0x7FFF, 1);
+		obs_properties_add_int(pp, name("pan_per_width").c_str(), obs_module_text("Pan steps across the image"), -0x8000, 0x7FFF, 1);
+		obs_properties_add_int(pp, name("tilt_per_height").c_str(), obs_module_text("Tilt steps across the image"), -0x8000, 0x7FFF, 1);
+		obs_properties_add_button(pp, name("calibrate_center").c_str(), obs_module_text("Set the center from the current position"), follower_calibrate_center);
+		obs_properties_add_button(pp, name("calibrate_corner").c_str(), obs_module_text("Set the steps from the current position at the bottom-right corner"), follower_calibrate_corner);
+		obs_properties_add_int(pp, name("zoom").c_str(), obs_module_text("Zoom (-1 to keep)"), -1, ZOOM_RAW_MAX, 1);
+		const std::string text = std::string(obs_module_text("Follower camera")) + " " + std::to_string(i + 1);
+		obs_properties_add_group(props, follower_group(i).c_str(), text.c_str(), OBS_GROUP_CHECKABLE, pp);
+	}
+#endif // WITH_PTZ_TCP
+
 	{
 		obs_properties_t *pp = obs_properties_create();
 		obs_properties_add_bool(pp, "debug_faces", "Show face detection results");
@@ -482,9 +716,16 @@ static void ftptz_get_defaults(obs_data_t *settings)
 	obs_data_set_default_double(settings, "Tdlpf", 2.0);
 	obs_data_set_default_double(settings, "Tdlpf_z", 6.0);
 	obs_data_set_default_double(settings, "Tatt_int", 2.0);
+	obs_data_set_default_bool(settings, "latency_compensation", false);
+	obs_data_set_default_double(settings, "latency_ms", 0.0);
+	obs_data_set_default_int(settings, "control_mode", ptz_control_mode_speed);
+	obs_data_set_default_int(settings, "pos_pan_per_width", 1000);
+	obs_data_set_default_int(settings, "pos_tilt_per_height", 560);
+	obs_data_set_default_double(settings, "pos_gain", 0.7);
 
 	obs_data_set_default_double(settings, "face_lost_preset_timeout", 5.0);
 	obs_data_set_default_int(settings, "face_lost_ptz_preset", -1);
+	obs_data_set_default_int(settings, "ptz-viscaip-zoom_poll_ms", 100);
 	obs_data_set_default_double(settings, "face_lost_zoomout_timeout", 4.0);
 
 	obs_data_t *presets = obs_data_create();
@@ -493,9 +734,21 @@ static void ftptz_get_defaults(obs_data_t *settings)
 
 	obs_data_set_default_string(settings, "ptz-type", "obsptz");
 	obs_data_set_default_int(settings, "ptz-viscaip-port", 1259);
+	obs_data_set_default_int(settings, "ptz-viscaudp-port", 52381);
 	obs_data_set_default_int(settings, "ptz_max_x", PTZ_MAX_X);
 	obs_data_set_default_int(settings, "ptz_max_y", PTZ_MAX_Y);
 	obs_data_set_default_int(settings, "ptz_max_z", PTZ_MAX_Z);
+
+	for (int i=0; i<FTPTZ_N_FOLLOWERS; i++) {
+		const std::string prefix = follower_prefix(i);
+		obs_data_set_default_string(settings, (prefix + "ptz-type").c_str(), "visca-over-tcp");
+		obs_data_set_default_int(settings, (prefix + "ptz-viscaip-port").c_str(), 1259);
+		obs_data_set_default_int(settings, (prefix + "ptz-viscaudp-port").c_str(), 52381);
+		obs_data_set_default_int(settings, (prefix + "ptz-viscaip-zoom_poll_ms").c_str(), 100);
+		obs_data_set_default_int(settings, (prefix + "pan_per_width").c_str(), 1000);
+		obs_data_set_default_int(settings, (prefix + "tilt_per_height").c_str(), 560);
+		obs_data_set_default_int(settings, (prefix + "zoom").c_str(), -1);
+	}
 }
 
 static inline float raw2zoomfactor(int zoom)
@@ -504,6 +757,12 @@ static inline float raw2zoomfactor(int zoom)
 	return expf((float)zoom * (logf(20.0f) / 16384.f));
 }
 
+static inline int zoomfactor2raw(float f)
+{
+	int zoom = (int)roundf(logf(f) * (16384.f / logf(20.0f)));
+	return zoom < 0 ? 0 : zoom > ZOOM_RAW_MAX ? ZOOM_RAW_MAX : zoom;
+}
+
 static inline int pan_flt2raw(float x)
 {
 	// TODO: configurable
@@ -627,11 +886,58 @@ static void register_hotkeys(struct face_tracker_ptz *s, obs_source_t *target)
 	}
 }
 
+// Returns the smallest input that flt2raw maps to n or larger, n > 0.
+static float raw2flt_lower(int (*flt2raw)(float), int n)
+{
+	float lo = 0.0f, hi = 128.0f;
+	for (int k=0; k<20; k++) {
+		float mid = (lo + hi) * 0.5f;
+		if (flt2raw(mid) >= n)
+			hi = mid;
+		else
+			lo = mid;
+	}
+	return hi;
+}
+
+/*
+ * Smith predictor for pan and tilt
+ * The motion that has been commanded but has not appeared in the error because of the latency
+ * is subtracted from the error so that the PID control element does not command the same motion again.
+ */
+static void compensate_latency(struct face_tracker_ptz *s, f3 &e, float second)
+{
+	if (s->face_found && s->face_found_last) {
+		for (int i=0; i<2; i++)
+			s->delay_est[i].observe(s->detect_err.v[i] - s->detect_err_prev.v[i]);
+	}
+	s->detect_err_prev = s->detect_err;
+
+	if (s->tick_second_avg <= 0.0f)
+		s->tick_second_avg = second;
+	else
+		s->tick_second_avg += (second - s->tick_second_avg) * 0.05f;
+
+	for (int i=0; i<2; i++) {
+		int lag = s->delay_est[i].get_delay();
+		if (s->latency_fixed > 0.0f && s->tick_second_avg > 0.0f)
+			lag = std::max((int)roundf(s->latency_fixed / s->tick_second_avg) - 1, 0);
+		if (lag >= ptz_delay_estimator::n_lag)
+			lag = ptz_delay_estimator::n_lag - 1;
+		s->latency_ticks[i] = lag;
+
+		if (!s->latency_compensation || lag <= 0 || !s->face_found)
+			continue;
+		e.v[i] -= s->delay_est[i].get_gain(lag) * s->delay_est[i].get_pending(lag);
+	}
+}
+
 static void tick_filter(struct face_tracker_ptz *s, float second)
 {
 	const float srwh = sqrtf((float)s->known_width * s->known_height);
 
 	f3 e = s->detect_err;
+	compensate_latency(s, e, second);
 	f3 e_int = e;
 	for (int i=0; i<3; i++) {
 		float x = e.v[i];
@@ -693,9 +999,20 @@ static void tick_filter(struct face_tracker_ptz *s, float second)
 			case 1:  n = tilt_flt2raw(x); break;
 			default: n = zoom_flt2raw(x, n); break;
 		}
-		if      (n < -u_max[i]) n = -u_max[i];
-		else if (n > +u_max[i]) n = +u_max[i];
+		bool clipped = false;
+		if      (n < -u_max[i]) { n = -u_max[i]; clipped = true; }
+		else if (n > +u_max[i]) { n = +u_max[i]; clipped = true; }
 		s->u[i] = n;
+
+		if (i < 2) {
+			// Record the motion actually commanded in the unit of the error.
+			float xa = x;
+			if (n == 0)
+				xa = 0.0f;
+			else if (clipped)
+				xa = raw2flt_lower(i == 0 ? pan_flt2raw : tilt_flt2raw, std::abs(n)) * (n > 0 ? 1.0f : -1.0f);
+			s->delay_cmd[i] = kp[i] != 0.0f ? xa / kp[i] : 0.0f;
+		}
 	}
 
 	if (s->debug_data_control) {
@@ -711,16 +1028,75 @@ static void tick_filter(struct face_tracker_ptz *s, float second)
 	}
 }
 
+/*
+ * Computes the pose of the camera that brings the face to the target location
+ * from the current pose and the error on the image.
+ * The error is converted to the pan and tilt steps using the field of view at the wide end
+ * and the zoom factor of the current pose.
+ */
+static void tick_position(struct face_tracker_ptz *s)
+{
+	const float srwh = sqrtf((float)s->known_width * s->known_height);
+	const float zf = raw2zoomfactor(s->ptz_query[2]);
+
+	f3 e = s->detect_err;
+	for (int i=0; i<3; i++) {
+		if (std::abs(e.v[i]) <= srwh * s->e_deadband.v[i])
+			e.v[i] = 0.0f;
+	}
+
+	const float inv_x = s->kp_x < 0.0f ? -1.0f : 1.0f;
+	const float inv_y = s->kp_y < 0.0f ? -1.0f : 1.0f;
+	float dpan = e.v[0] / s->known_width * s->pos_pan_per_width / zf * inv_x;
+	float dtilt = -e.v[1] / s->known_height * s->pos_tilt_per_height / zf * inv_y; // tilt position increases upward
+	s->ptz_target[0] = s->ptz_query[0] + (int)roundf(dpan * s->pos_gain);
+	s->ptz_target[1] = s->ptz_query[1] + (int)roundf(dtilt * s->pos_gain);
+
+	// The size of the face is proportional to the zoom factor.
+	float ratio = (srwh + e.v[2]) / srwh;
+	if (ratio < 0.1f)
+		ratio = 0.1f;
+	s->ptz_target[2] = zoomfactor2raw(zf * powf(ratio, -s->pos_gain));
+
+	if (s->ptz_max_x <= 0)
+		s->ptz_target[0] = s->ptz_query[0];
+	if (s->ptz_max_y <= 0)
+		s->ptz_target[1] = s->ptz_query[1];
+	if (s->ptz_max_z <= 0)
+		s->ptz_target[2] = s->ptz_query[2];
+
+	if (s->face_found) {
+		s->face_found_last_ns = obs_get_video_frame_time();
+		s->face_lost_preset_sent = 0;
+	}
+}
+
 static void ftf_activate(void *data)
 {
 	auto *s = (struct face_tracker_ptz*)data;
 	s->is_active = true;
+	s->ftm->is_active = s->is_active || s->is_showing;
 }
 
 static void ftf_deactivate(void *data)
 {
 	auto *s = (struct face_tracker_ptz*)data;
 	s->is_active = false;
+	s->ftm->is_active = s->is_active || s->is_showing;
+}
+
+static void ftf_show(void *data)
+{
+	auto *s = (struct face_tracker_ptz*)data;
+	s->is_showing = true;
+	s->ftm->is_active = s->is_active || s->is_showing;
+}
+
+static void ftf_hide(void *data)
+{
+	auto *s = (struct face_tracker_ptz*)data;
+	s->is_showing = false;
+	s->ftm->is_active = s->is_active || s->is_showing;
 }
 
 template <typename T> static inline bool diff3(T a, T b, T c)
@@ -753,27 +1129,118 @@ static bool send_ptz_cmd_recall_if_timeout(struct face_tracker_ptz *s)
 
 static inline void send_ptz_cmd_immediate(struct face_tracker_ptz *s)
 {
+	if (s->is_paused)
+		s->face_found_last_ns = 0;
+
+	/* The estimator correlates the error with the motion of the camera.
+	 * A speed stays in effect until the next one is sent, so the last speed sent is recorded
+	 * while the backend cannot take a new one. A preset recall overrides the speed. */
+	if (send_ptz_cmd_recall_if_timeout(s)) {
+		s->delay_cmd_sent[0] = s->delay_cmd_sent[1] = 0.0f;
+	}
+	else {
+		if (s->face_lost_zoomout_timeout_ms > 0 && s->face_found_last_ns &&
+		    s->face_found_last_ns + s->face_lost_zoomout_timeout_ms * 1000000ULL < obs_get_video_frame_time()) {
+			s->u[2] = 1.0f;
+		}
+
+		if (s->ftm->dev && s->ftm->can_send_ptz_cmd()) {
+			s->ftm->dev->set_speed(s->u[0], s->u[1], s->u[2]);
+			s->delay_cmd_sent[0] = s->delay_cmd[0];
+			s->delay_cmd_sent[1] = s->delay_cmd[1];
+		}
+	}
+
+	for (int i = 0; i < 2; i++)
+		s->delay_est[i].push_command(s->delay_cmd_sent[i]);
+}
+
+static void send_ptz_cmd_position(struct face_tracker_ptz *s)
+{
+	// The position move overrides the speed.
+	for (int i = 0; i < 2; i++) {
+		s->delay_cmd_sent[i] = 0.0f;
+		s->delay_est[i].push_command(0.0f);
+	}
+
 	if (s->is_paused)
 		s->face_found_last_ns = 0;
 
 	if (send_ptz_cmd_recall_if_timeout(s))
 		return;
 
+	if (!s->ftm->dev || !s->ftm->can_send_ptz_cmd())
+		return;
+
 	if (s->face_lost_zoomout_timeout_ms > 0 && s->face_found_last_ns &&
 	    s->face_found_last_ns + s->face_lost_zoomout_timeout_ms * 1000000ULL < obs_get_video_frame_time()) {
-		s->u[2] = 1.0f;
+		if (s->ptz_target_last[2] != 0 || !s->ptz_target_sent) {
+			s->ftm->dev->move_zoom_absolute(0);
+			if (!s->ptz_target_sent) {
+				s->ptz_target_last[0] = s->ptz_query[0];
+				s->ptz_target_last[1] = s->ptz_query[1];
+				s->ptz_target_sent = true;
+			}
+			s->ptz_target_last[2] = 0;
+		}
+		return;
 	}
 
-	for (int i=0; i<2 && s->ftm->dev && s->ftm->can_send_ptz_cmd(); i++) {
-		if (s->ftm->ptz_last_cmd != ptz_cmd_state_pantilt) {
-			s->ftm->dev->set_pantilt_speed(s->u[0], s->u[1]);
-			s->ftm->ptz_last_cmd = ptz_cmd_state_pantilt;
-		}
-		else {
-			s->ftm->dev->set_zoom_speed(s->u[2]);
-			s->ftm->ptz_last_cmd = ptz_cmd_state_zoom;
-		}
+	// Keep the last target while the face is not found so that the camera stops there.
+	if (!s->face_found)
+		return;
+
+	const int th_pan = std::max(1, s->pos_pan_per_width / 200);
+	const int th_tilt = std::max(1, s->pos_tilt_per_height / 200);
+	const int th_zoom = ZOOM_RAW_MAX / 400;
+	if (!s->ptz_target_sent ||
+	    std::abs(s->ptz_target[0] - s->ptz_target_last[0]) > th_pan ||
+	    std::abs(s->ptz_target[1] - s->ptz_target_last[1]) > th_tilt) {
+		s->ftm->dev->move_pantilt_absolute(s->ptz_target[0], s->ptz_target[1],
+				std::max(1, s->ptz_max_x), std::max(1, s->ptz_max_y));
+		s->ptz_target_last[0] = s->ptz_target[0];
+		s->ptz_target_last[1] = s->ptz_target[1];
+	}
+	if (!s->ptz_target_sent || std::abs(s->ptz_target[2] - s->ptz_target_last[2]) > th_zoom) {
+		s->ftm->dev->move_zoom_absolute(s->ptz_target[2]);
+		s->ptz_target_last[2] = s->ptz_target[2];
 	}
+	s->ptz_target_sent = true;
+}
+
+static void send_ptz_cmd_follower(struct face_tracker_ptz *s, struct ftptz_follower_s *f)
+{
+	if (!f->dev || !f->dev->can_move_position() || !f->dev->can_send())
+		return;
+
+	if (f->zoom >= 0 && !f->zoom_sent) {
+		f->dev->move_zoom_absolute(f->zoom);
+		f->zoom_sent = true;
+	}
+
+	if (s->is_paused || !s->face_found)
+		return;
+
+	const float x = s->face_pos.v[0] / s->known_width - 0.5f;
+	const float y = s->face_pos.v[1] / s->known_height - 0.5f;
+	const int pan = f->pan_center + (int)roundf(x * f->pan_per_width);
+	const int tilt = f->tilt_center - (int)roundf(y * f->tilt_per_height); // tilt position increases upward
+
+	const int th_pan = std::max(1, std::abs(f->pan_per_width) / 200);
+	const int th_tilt = std::max(1, std::abs(f->tilt_per_height) / 200);
+	if (f->target_sent && std::abs(pan - f->target_last[0]) <= th_pan && std::abs(tilt - f->target_last[1]) <= th_tilt)
+		return;
+
+	f->dev->move_pantilt_absolute(pan, tilt, std::max(1, s->ptz_max_x), std::max(1, s->ptz_max_y));
+	f->target_last[0] = pan;
+	f->target_last[1] = tilt;
+	f->target_sent = true;
+}
+
+static void send_ptz_cmd_followers(struct face_tracker_ptz *s)
+{
+	for (int i=0; i<FTPTZ_N_FOLLOWERS; i++)
+		send_ptz_cmd_follower(s, &s->followers[i]);
 }
 
 static inline void calculate_error(struct face_tracker_ptz *s);
@@ -810,13 +1277,31 @@ static void ftptz_tick(void *data, float second)
 			s->detect_err = f3(0, 0, 0);
 		}
 
-		tick_filter(s, second);
-		send_ptz_cmd_immediate(s);
+		// The position control needs the current pose; use the speed control until the camera tells it.
+		if (s->control_mode == ptz_control_mode_position && s->ptz_query_valid) {
+			tick_position(s);
+			send_ptz_cmd_position(s);
+		}
+		else {
+			s->ptz_target_sent = false;
+			tick_filter(s, second);
+			send_ptz_cmd_immediate(s);
+		}
+
+		send_ptz_cmd_followers(s);
+	}
+
+	for (int i=0; i<FTPTZ_N_FOLLOWERS; i++) {
+		if (s->followers[i].dev)
+			s->followers[i].dev->tick();
 	}
 
 	if (s->ftm && s->ftm->dev) {
 		s->ftm->dev->tick();
 		s->ptz_query[2] = s->ftm->dev->get_zoom();
+		s->ptz_query_valid = s->control_mode == ptz_control_mode_position &&
+			s->ftm->dev->can_move_position() &&
+			s->ftm->dev->get_position(s->ptz_query[0], s->ptz_query[1]);
 	}
 }
 
@@ -828,9 +1313,10 @@ static inline void render_target(struct face_tracker_ptz *s, obs_source_t *, obs
 static inline void calculate_error(struct face_tracker_ptz *s)
 {
 	f3 e_tot(0.0f, 0.0f, 0.0f);
+	f3 p_tot(0.0f, 0.0f, 0.0f);
 	float sc_tot = 0.0f;
 	bool found = false;
-	auto &tracker_rects = s->ftm->tracker_rects;
+	const auto &tracker_rects = *s->ftm->tracker_rects;
 	for (size_t i = 0; i < tracker_rects.size(); i++) {
 		f3 r (tracker_rects[i].rect);
 		float score = tracker_rects[i].rect.score;
@@ -852,6 +1338,7 @@ static inline void calculate_error(struct face_tracker_ptz *s)
 					r.v[0], r.v[1], r.v[2], score );
 		}
 
+		f3 p = r;
 		r.v[0] -= get_width(tracker_rects[i].crop_rect) * s->track_x;
 		r.v[1] += get_height(tracker_rects[i].crop_rect) * s->track_y;
 		r.v[2] /= s->track_z;
@@ -860,13 +1347,16 @@ static inline void calculate_error(struct face_tracker_ptz *s)
 		f3 e = (r-w) * score;
 		if (score>0.0f && !isnan(e)) {
 			e_tot += e;
+			p_tot += p * score;
 			sc_tot += score;
 			found = true;
 		}
 	}
 
-	if (found)
+	if (found) {
 		s->detect_err = e_tot * (1.0f / sc_tot);
+		s->face_pos = p_tot * (1.0f / sc_tot);
+	}
 	else
 		s->detect_err = f3(0, 0, 0);
 	s->face_found = found;
@@ -958,13 +1448,8 @@ static bool scale_set_texture(struct face_tracker_ptz *s, std::shared_ptr<textur
 	return true;
 }
 
-static struct obs_source_frame *ftptz_filter_video(void *data, struct obs_source_frame *frame)
+static std::shared_ptr<texture_object> frame_to_cvtex(struct face_tracker_ptz *s, struct obs_source_frame *frame)
 {
-	if (!frame)
-		return NULL;
-
-	auto *s = (struct face_tracker_ptz*)data;
-
 	std::shared_ptr<texture_object> cvtex(new texture_object());
 	cvtex.get()->scale = s->ftm->scale;
 	cvtex.get()->tick = s->ftm->tick_cnt;
@@ -975,9 +1460,19 @@ static struct obs_source_frame *ftptz_filter_video(void *data, struct obs_source
 		scale_set_texture(s, cvtex, frame);
 	}
 
+	return cvtex;
+}
+
+static struct obs_source_frame *ftptz_filter_video(void *data, struct obs_source_frame *frame)
+{
+	if (!frame)
+		return NULL;
+
+	auto *s = (struct face_tracker_ptz*)data;
+
 	s->known_width = frame->width;
 	s->known_height = frame->height;
-	s->ftm->cvtex_cache.swap(cvtex);
+	s->ftm->cvtex_cache.reset();
 	s->ftm->crop_cur.x0 = 0;
 	s->ftm->crop_cur.y0 = 0;
 	s->ftm->crop_cur.x1 = frame->width;
@@ -985,7 +1480,9 @@ static struct obs_source_frame *ftptz_filter_video(void *data, struct obs_source
 
 	s->rendered = true;
 
+	s->ftm->frame_cur = frame;
 	s->ftm->post_render();
+	s->ftm->frame_cur = NULL;
 	return frame;
 }
 
@@ -1004,8 +1501,8 @@ static void draw_frame_info(struct face_tracker_ptz *s, bool landmark_only = fal
 		}
 
 		gs_effect_set_color(gs_effect_get_param_by_name(effect, "color"), 0xFF00FF00);
-		for (size_t i = 0; i < s->ftm->tracker_rects.size(); i++) {
-			const auto &tr = s->ftm->tracker_rects[i];
+		for (size_t i = 0; i < s->ftm->tracker_rects->size(); i++) {
+			const auto &tr = (*s->ftm->tracker_rects)[i];
 			if (draw_trk)
 				draw_rect_upsize(tr.rect);
 			if (draw_lmk && tr.landmark.size())
@@ -1057,6 +1554,10 @@ static void cb_get_state(void *data, calldata_t *cd)
 {
 	auto *s = (struct face_tracker_ptz*)data;
 	calldata_set_bool(cd, "paused", s->is_paused);
+	calldata_set_float(cd, "tracking_rate", s->ftm->tracking_rate_measured);
+	calldata_set_float(cd, "tracking_rate_limit", s->ftm->tracking_rate_eff);
+	if (s->latency_ticks[0] >= 0)
+		calldata_set_float(cd, "latency", (s->latency_ticks[0] + 1) * s->tick_second_avg);
 }
 
 static void cb_set_state(void *data, calldata_t *cd)
@@ -1078,7 +1579,7 @@ static void cb_set_state(void *data, calldata_t *cd)
 static void emit_state_changed(struct face_tracker_ptz *s)
 {
 	struct calldata cd;
-	uint8_t stack[128];
+	uint8_t stack[256];
 
 	calldata_init_fixed(&cd, stack, sizeof(stack));
 	calldata_set_ptr(&cd, "source", s->context);
@@ -1105,6 +1606,8 @@ void register_face_tracker_ptz(bool hide_ptz)
 	info.get_defaults = ftptz_get_defaults;
 	info.activate = ftf_activate,
 	info.deactivate = ftf_deactivate,
+	info.show = ftf_show,
+	info.hide = ftf_hide,
 	info.video_tick = ftptz_tick;
 	info.filter_video = ftptz_filter_video;
 	info.video_render = ftptz_video_render;
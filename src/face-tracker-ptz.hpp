@@ -3,6 +3,26 @@
 #include <vector>
 #include <deque>
 #include "helper.hpp"
+#include "ptz-delay.hpp"
+
+#define FTPTZ_N_FOLLOWERS 3
+
+/*
+ * A camera that follows the face found by the filter without running its own detector.
+ * The face location on the image is mapped to the pan and tilt position of the camera
+ * by the position at the center of the image and the steps across the image.
+ */
+struct ftptz_follower_s
+{
+	class ptz_backend *dev;
+	char *ptz_type;
+	int pan_center, tilt_center;
+	int pan_per_width, tilt_per_height;
+	int zoom; // -1 to keep
+	int target_last[2];
+	bool target_sent;
+	bool zoom_sent;
+};
 
 struct face_tracker_ptz
 {
@@ -11,6 +31,7 @@ struct face_tracker_ptz
 	uint32_t known_height;
 	bool rendered;
 	bool is_active;
+	bool is_showing;
 
 	video_scaler_t *scaler;
 	uint8_t *scaler_buffer;
@@ -18,6 +39,8 @@ struct face_tracker_ptz
 	struct video_scale_info scaler_dst_info;
 
 	f3 detect_err;
+	f3 detect_err_prev;
+	f3 face_pos; // location and size of the face on the image, available if face_found
 	bool face_found, face_found_last;
 
 	class ft_manager_for_ftptz *ftm;
@@ -34,6 +57,22 @@ struct face_tracker_ptz
 	float f_att_int;
 	int u[3];
 	int ptz_query[3];
+	bool ptz_query_valid; // pan and tilt in ptz_query are available
+
+	int control_mode;
+	int pos_pan_per_width, pos_tilt_per_height;
+	float pos_gain;
+	bool latency_compensation;
+	float latency_fixed; // 0 to estimate
+	ptz_delay_estimator delay_est[2]; // pan and tilt
+	float delay_cmd[2]; // motion of u[0] and u[1] in the unit of the error
+	float delay_cmd_sent[2]; // delay_cmd of the speed in effect on the camera, recorded at every tick
+	int latency_ticks[2];
+	float tick_second_avg;
+
+	int ptz_target[3];
+	int ptz_target_last[3]; // the target sent to the camera
+	bool ptz_target_sent;
 	uint64_t face_found_last_ns;
 	int face_lost_preset_sent;
 
@@ -54,6 +93,8 @@ struct face_tracker_ptz
 	char *ptz_type;
 	int ptz_max_x, ptz_max_y, ptz_max_z;
 
+	struct ftptz_follower_s followers[FTPTZ_N_FOLLOWERS];
+
 	bool is_paused;
 	obs_hotkey_pair_id hotkey_pause;
 	obs_hotkey_id hotkey_reset;
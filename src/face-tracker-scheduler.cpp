@@ -0,0 +1,119 @@
+#include <obs-module.h>
+#include <util/platform.h>
+#include <algorithm>
+#include "plugin-macros.generated.h"
+#include "face-tracker-scheduler.hpp"
+#include "face-tracker-manager.hpp"
+
+#define UPDATE_INTERVAL_NS 500000000 // 0.5 second
+#define RATE_MIN_ACTIVE 5.0f // Hz
+#define RATE_MIN_INACTIVE 1.0f // Hz
+#define DETECT_INTERVAL_ACTIVE 2.0f // second
+#define DETECT_INTERVAL_INACTIVE 8.0f // second
+
+face_tracker_scheduler::face_tracker_scheduler()
+{
+	pthread_mutex_init(&mutex, NULL);
+	last_update_ns = 0;
+
+	// Leave the rest of the cores for rendering and encoding.
+	int cores = os_get_logical_cores();
+	budget = cores > 2 ? cores * 0.5f : 1.0f;
+	blog(LOG_INFO, "face_tracker_scheduler: %d logical cores, budget %.1f cores", cores, budget);
+}
+
+face_tracker_scheduler::~face_tracker_scheduler()
+{
+	pthread_mutex_destroy(&mutex);
+}
+
+face_tracker_scheduler &face_tracker_scheduler::get()
+{
+	static face_tracker_scheduler instance;
+	return instance;
+}
+
+void face_tracker_scheduler::add(face_tracker_manager *ftm)
+{
+	pthread_mutex_lock(&mutex);
+	managers.push_back(ftm);
+	pthread_mutex_unlock(&mutex);
+}
+
+void face_tracker_scheduler::remove(face_tracker_manager *ftm)
+{
+	pthread_mutex_lock(&mutex);
+	auto it = std::find(managers.begin(), managers.end(), ftm);
+	if (it != managers.end())
+		managers.erase(it);
+	pthread_mutex_unlock(&mutex);
+}
+
+void face_tracker_scheduler::tick()
+{
+	uint64_t ns = os_gettime_ns();
+	pthread_mutex_lock(&mutex);
+	if (ns - last_update_ns >= UPDATE_INTERVAL_NS) {
+		last_update_ns = ns;
+		update_locked();
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+static inline bool is_scheduled_active(const face_tracker_manager *ftm)
+{
+	// A hidden PTZ filter still has to follow the face.
+	return ftm->is_active || ftm->drives_camera;
+}
+
+static inline float tracker_cost(const face_tracker_manager *ftm)
+{
+	// CPU time in second to update all trackers once
+	return ftm->tracking_latency * ftm->trackers.size();
+}
+
+static inline float detector_load(const face_tracker_manager *ftm, float interval)
+{
+	return ftm->detect_latency / interval;
+}
+
+static inline float tracker_rate_for(const face_tracker_manager *ftm, float share, float interval, float rate_min)
+{
+	const float cost = tracker_cost(ftm);
+	if (cost <= 0.0f)
+		return 0.0f;
+	float rate = (share - detector_load(ftm, interval)) / cost;
+	return rate > rate_min ? rate : rate_min;
+}
+
+void face_tracker_scheduler::update_locked()
+{
+	int n_active = 0, n_inactive = 0;
+	float load_active = 0.0f;
+	for (auto *ftm : managers) {
+		if (is_scheduled_active(ftm)) {
+			n_active++;
+			load_active += detector_load(ftm, DETECT_INTERVAL_ACTIVE);
+			load_active += tracker_cost(ftm) * ftm->tracking_rate_measured;
+		}
+		else
+			n_inactive++;
+	}
+
+	const bool limit_active = load_active > budget;
+	const float remaining = limit_active ? 0.0f : budget - load_active;
+
+	for (auto *ftm : managers) {
+		if (is_scheduled_active(ftm)) {
+			ftm->detect_interval = DETECT_INTERVAL_ACTIVE;
+			ftm->sched_rate_limit = limit_active ?
+				tracker_rate_for(ftm, budget / n_active, DETECT_INTERVAL_ACTIVE, RATE_MIN_ACTIVE) : 0.0f;
+		}
+		else {
+			ftm->detect_interval = DETECT_INTERVAL_INACTIVE;
+			ftm->sched_rate_limit = tracker_rate_for(ftm, remaining / n_inactive, DETECT_INTERVAL_INACTIVE, RATE_MIN_INACTIVE);
+			if (ftm->sched_rate_limit <= 0.0f)
+				ftm->sched_rate_limit = RATE_MIN_INACTIVE;
+		}
+	}
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <vector>
+#include <util/threading.h>
+
+/*
+ * Shares the CPU among all face_tracker_manager instances in the process.
+ * Each manager registers itself at construction.
+ * The scheduler periodically sets the tracking rate limit and the detection interval of each manager
+ * so that the sources shown on the program or the preview and the PTZ filters run first
+ * and the other sources use only the remaining budget.
+ */
+class face_tracker_scheduler
+{
+	pthread_mutex_t mutex;
+	std::vector<class face_tracker_manager *> managers;
+	uint64_t last_update_ns;
+	float budget; // number of cores to be used by all the managers
+
+	face_tracker_scheduler();
+	~face_tracker_scheduler();
+	void update_locked();
+
+public:
+	static face_tracker_scheduler &get();
+
+	void add(class face_tracker_manager *ftm);
+	void remove(class face_tracker_manager *ftm);
+	void tick(); // called from each manager's tick
+};
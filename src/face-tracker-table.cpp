@@ -0,0 +1,154 @@
+#include <obs-module.h>
+#include <algorithm>
+#include "plugin-macros.generated.h"
+#include "face-tracker-manager.hpp"
+#include "helper.hpp"
+
+size_t face_tracker_manager::tracker_table_s::add(face_tracker_base *t)
+{
+	tracker.push_back(t);
+	rect.push_back(rect_s{0, 0, 0, 0, 0.0f});
+	crop_tracker.push_back(rectf_s{0.0f, 0.0f, 0.0f, 0.0f});
+	crop_rect.push_back(rectf_s{0.0f, 0.0f, 0.0f, 0.0f});
+	att.push_back(0.0f);
+	score_first.push_back(0.0f);
+	state.push_back(tracker_state_init);
+	tick_cnt.push_back(0);
+	tick_tracker.push_back(0);
+	tick_rect.push_back(0);
+	motion.push_back(motion_model());
+	time_staged.push_back(0.0f);
+	warm.push_back(false);
+	seq.push_back(0);
+	n_landmark.push_back(0);
+	landmark.resize(tracker.size() * landmark_stride);
+	return tracker.size() - 1;
+}
+
+void face_tracker_manager::tracker_table_s::remove(size_t i)
+{
+	const size_t last = tracker.size() - 1;
+	if (i != last) {
+		tracker[i] = tracker[last];
+		rect[i] = rect[last];
+		crop_tracker[i] = crop_tracker[last];
+		crop_rect[i] = crop_rect[last];
+		att[i] = att[last];
+		score_first[i] = score_first[last];
+		state[i] = state[last];
+		tick_cnt[i] = tick_cnt[last];
+		tick_tracker[i] = tick_tracker[last];
+		tick_rect[i] = tick_rect[last];
+		motion[i] = motion[last];
+		time_staged[i] = time_staged[last];
+		warm[i] = warm[last];
+		seq[i] = seq[last];
+		n_landmark[i] = n_landmark[last];
+		std::copy(
+				landmark.begin() + last * landmark_stride,
+				landmark.begin() + last * landmark_stride + n_landmark[last],
+				landmark.begin() + i * landmark_stride );
+	}
+	tracker.pop_back();
+	rect.pop_back();
+	crop_tracker.pop_back();
+	crop_rect.pop_back();
+	att.pop_back();
+	score_first.pop_back();
+	state.pop_back();
+	tick_cnt.pop_back();
+	tick_tracker.pop_back();
+	tick_rect.pop_back();
+	motion.pop_back();
+	time_staged.pop_back();
+	warm.pop_back();
+	seq.pop_back();
+	n_landmark.pop_back();
+	landmark.resize(last * landmark_stride);
+}
+
+void face_tracker_manager::tracker_table_s::set_landmark(size_t i, const std::vector<pointf_s> &lm)
+{
+	if (lm.size() > landmark_stride) {
+		// Widen the blocks. Happens only when a model having more points is loaded.
+		std::vector<pointf_s> l(tracker.size() * lm.size());
+		for (size_t k = 0; k < tracker.size(); k++) {
+			std::copy(
+					landmark.begin() + k * landmark_stride,
+					landmark.begin() + k * landmark_stride + n_landmark[k],
+					l.begin() + k * lm.size() );
+		}
+		landmark.swap(l);
+		landmark_stride = lm.size();
+	}
+
+	std::copy(lm.begin(), lm.end(), landmark.begin() + i * landmark_stride);
+	n_landmark[i] = (int)lm.size();
+}
+
+static inline void predict_tracker_rect(face_tracker_manager::tracker_rect_s &r, pointf_s *lm, const motion_model &motion, int tick, const rectf_s &crop_cur)
+{
+	const f3 u0(r.rect);
+	const f3 u = motion.predict(tick);
+	if (u0.v[2] <= 0.0f || isnan(u))
+		return;
+
+	const float k = u.v[2] / u0.v[2];
+	const rectf_s rf = f3_to_rectf(u, get_width(r.rect), get_height(r.rect));
+	r.rect.x0 = (int)rf.x0;
+	r.rect.y0 = (int)rf.y0;
+	r.rect.x1 = (int)rf.x1;
+	r.rect.y1 = (int)rf.y1;
+
+	for (size_t j = 0; j < r.landmark.n; j++) {
+		lm[j].x = u.v[0] + (lm[j].x - u0.v[0]) * k;
+		lm[j].y = u.v[1] + (lm[j].y - u0.v[1]) * k;
+	}
+
+	// The predicted box is for the current frame, compare it with the current crop.
+	if (crop_cur.x1 > crop_cur.x0 && crop_cur.y1 > crop_cur.y0)
+		r.crop_rect = crop_cur;
+}
+
+void make_tracker_rects(
+		face_tracker_manager::tracker_rects_s &tracker_rects,
+		const face_tracker_manager::tracker_table_s &trackers,
+		bool motion_prediction, int tick_cnt, const rectf_s &crop_cur )
+{
+	// Reserve the arena first so that the spans won't be invalidated.
+	size_t n_landmark = 0;
+	for (size_t i = 0; i < trackers.size(); i++)
+		n_landmark += trackers.n_landmark[i];
+	tracker_rects.landmark.resize(n_landmark);
+
+	size_t n = 0;
+	n_landmark = 0;
+	for (size_t i = 0; i < trackers.size(); i++) {
+		if (trackers.state[i] != face_tracker_manager::tracker_state_available)
+			continue;
+
+		float score = trackers.rect[i].score * trackers.att[i];
+
+		if (score<=0.0f || isnan(score))
+			continue;
+
+		if (tracker_rects.rects.size() <= n)
+			tracker_rects.rects.resize(n+1);
+		auto &r = tracker_rects.rects[n++];
+
+		r.rect = trackers.rect[i];
+		r.rect.score = score;
+		r.crop_rect = trackers.crop_rect[i];
+
+		const pointf_s *lm = trackers.get_landmark(i);
+		pointf_s *dst = tracker_rects.landmark.data() + n_landmark;
+		std::copy(lm, lm + trackers.n_landmark[i], dst);
+		r.landmark = pointf_span_s(dst, trackers.n_landmark[i]);
+		n_landmark += trackers.n_landmark[i];
+
+		if (motion_prediction && trackers.motion[i].is_valid())
+			predict_tracker_rect(r, dst, trackers.motion[i], tick_cnt, crop_cur);
+	}
+
+	tracker_rects.n = n;
+}
@@ -15,16 +15,18 @@
 
 static inline void scale_texture(struct face_tracker_filter *s, float scale);
 static inline int stage_to_surface(struct face_tracker_filter *s, float scale);
-static inline std::shared_ptr<texture_object> surface_to_cvtex(struct face_tracker_filter *s, float scale);
+static inline std::shared_ptr<texture_object> surface_to_cvtex(struct face_tracker_filter *s);
 
 class ft_manager_for_ftf : public face_tracker_manager
 {
 	public:
 		struct face_tracker_filter *ctx;
+		std::shared_ptr<texture_object> cvtex_cache;
 
 	public:
 		ft_manager_for_ftf(struct face_tracker_filter *ctx_) {
 			ctx = ctx_;
+			cvtex_cache = NULL;
 		}
 
 		~ft_manager_for_ftf()
@@ -34,15 +36,15 @@ class ft_manager_for_ftf : public face_tracker_manager
 
 		inline void release_cvtex()
 		{
+			cvtex_cache.reset();
 		}
 
 		std::shared_ptr<texture_object> get_cvtex() override
 		{
-			if (scale<1.0f) scale = 1.0f;
-			scale_texture(ctx, scale);
-			if (stage_to_surface(ctx, scale))
-				return NULL;
-			return surface_to_cvtex(ctx, scale);
+			// The detector and the trackers share one read-back in a frame.
+			if (!cvtex_cache)
+				cvtex_cache = surface_to_cvtex(ctx);
+			return cvtex_cache;
 		};
 };
 
@@ -91,6 +93,8 @@ static void ftf_update(void *data, obs_data_t *settings)
 
 	get_aspect_from_str(s, obs_data_get_string(settings, "aspect"));
 
+	s->readback_luma = obs_data_get_bool(settings, "readback_luma");
+
 	s->debug_faces = obs_data_get_bool(settings, "debug_faces");
 	s->debug_notrack = obs_data_get_bool(settings, "debug_notrack");
 	s->debug_always_show = obs_data_get_bool(settings, "debug_always_show");
@@ -128,6 +132,7 @@ static void *ftf_create(obs_data_t *settings, obs_source_t *context)
 	auto *s = (struct face_tracker_filter*)bzalloc(sizeof(struct face_tracker_filter));
 	s->ftm = new ft_manager_for_ftf(s);
 	s->ftm->crop_cur.x1 = s->ftm->crop_cur.y1 = -2;
+	s->ftm->is_active = false;
 	s->context = context;
 	s->ftm->scale = 2.0f;
 	s->hotkey_pause = OBS_INVALID_HOTKEY_PAIR_ID;
@@ -173,8 +178,12 @@ static void ftf_destroy(void *data)
 	s->texrender = NULL;
 	gs_texrender_destroy(s->texrender_scaled);
 	s->texrender_scaled = NULL;
-	gs_stagesurface_destroy(s->stagesurface);
-	s->stagesurface = NULL;
+	gs_effect_destroy(s->effect_luma);
+	s->effect_luma = NULL;
+	for (int i = 0; i < N_STAGESURFACE; i++) {
+		gs_stagesurface_destroy(s->stagesurface[i].surface);
+		s->stagesurface[i].surface = NULL;
+	}
 	obs_leave_graphics();
 
 	delete s->ftm;
@@ -237,6 +246,10 @@ static obs_properties_t *ftf_properties(void *data)
 	{
 		obs_properties_t *pp = obs_properties_create();
 		face_tracker_manager::get_properties(pp);
+		obs_property_t *p = obs_properties_add_bool(pp, "readback_luma", obs_module_text("Read back grayscale image"));
+		obs_property_set_long_description(p, obs_module_text(
+					"Convert the frame to luma on GPU before reading it back. "
+					"CNN detector will receive grayscale image." ));
 		obs_properties_add_group(props, "ftm", obs_module_text("Face detection options"), OBS_GROUP_NORMAL, pp);
 	}
 
@@ -409,12 +422,28 @@ static void ftf_activate(void *data)
 {
 	auto *s = (struct face_tracker_filter*)data;
 	s->is_active = true;
+	s->ftm->is_active = s->is_active || s->is_showing;
 }
 
 static void ftf_deactivate(void *data)
 {
 	auto *s = (struct face_tracker_filter*)data;
 	s->is_active = false;
+	s->ftm->is_active = s->is_active || s->is_showing;
+}
+
+static void ftf_show(void *data)
+{
+	auto *s = (struct face_tracker_filter*)data;
+	s->is_showing = true;
+	s->ftm->is_active = s->is_active || s->is_showing;
+}
+
+static void ftf_hide(void *data)
+{
+	auto *s = (struct face_tracker_filter*)data;
+	s->is_showing = false;
+	s->ftm->is_active = s->is_active || s->is_showing;
 }
 
 static inline void calculate_error(struct face_tracker_filter *s);
@@ -635,7 +664,7 @@ static inline void calculate_error(struct face_tracker_filter *s)
 	f3 e_tot(0.0f, 0.0f, 0.0f);
 	float sc_tot = 0.0f;
 	bool found = false;
-	auto &tracker_rects = s->ftm->tracker_rects;
+	const auto &tracker_rects = *s->ftm->tracker_rects;
 	for (size_t i = 0; i < tracker_rects.size(); i++) {
 		f3 r (tracker_rects[i].rect);
 		float score = tracker_rects[i].rect.score;
@@ -685,10 +714,35 @@ static inline void calculate_error(struct face_tracker_filter *s)
 
 static inline void draw_sprite_crop(float width, float height, float x0, float y0, float x1, float y1);
 
+static inline gs_effect_t *get_effect_luma(struct face_tracker_filter *s)
+{
+	if (s->effect_luma || s->effect_luma_failed)
+		return s->effect_luma;
+
+	char *f = obs_module_file("rgb2luma.effect");
+	if (f)
+		s->effect_luma = gs_effect_create_from_file(f, NULL);
+	if (!s->effect_luma) {
+		blog(LOG_ERROR, "failed to load effect file '%s'", f ? f : "rgb2luma.effect");
+		s->effect_luma_failed = true;
+	}
+	bfree(f);
+
+	return s->effect_luma;
+}
+
 static inline void scale_texture(struct face_tracker_filter *s, float scale)
 {
-	if (!s->texrender_scaled)
-		s->texrender_scaled = gs_texrender_create(GS_BGRA, GS_ZS_NONE);
+	gs_effect_t *effect_luma = s->readback_luma ? get_effect_luma(s) : NULL;
+	const enum gs_color_format format = effect_luma ? GS_R8 : GS_BGRA;
+	if (s->texrender_scaled && s->scaled_format != format) {
+		gs_texrender_destroy(s->texrender_scaled);
+		s->texrender_scaled = NULL;
+	}
+	if (!s->texrender_scaled) {
+		s->texrender_scaled = gs_texrender_create(format, GS_ZS_NONE);
+		s->scaled_format = format;
+	}
 	const uint32_t cx = s->known_width / scale, cy = s->known_height / scale;
 	gs_texrender_reset(s->texrender_scaled);
 	gs_blend_state_push();
@@ -696,7 +750,7 @@ static inline void scale_texture(struct face_tracker_filter *s, float scale)
 	if (gs_texrender_begin(s->texrender_scaled, cx, cy)) {
 		gs_ortho(0.0f, (float)cx, 0.0f, (float)cy, -100.0f, 100.0f);
 		gs_texture_t *tex = gs_texrender_get_texture(s->texrender);
-		auto effect = obs_get_base_effect(OBS_EFFECT_DEFAULT);
+		auto effect = effect_luma ? effect_luma : obs_get_base_effect(OBS_EFFECT_DEFAULT);
 		if (tex && effect) {
 			gs_eparam_t *image = gs_effect_get_param_by_name(effect, "image");
 			gs_effect_set_texture(image, tex);
@@ -719,31 +773,69 @@ static inline int stage_to_surface(struct face_tracker_filter *s, float scale)
 	if (!tex)
 		return 2;
 
-	if (!s->stagesurface ||
-			width != gs_stagesurface_get_width(s->stagesurface) ||
-			height != gs_stagesurface_get_height(s->stagesurface) ) {
-		gs_stagesurface_destroy(s->stagesurface);
-		s->stagesurface = gs_stagesurface_create(width, height, GS_BGRA);
+	struct stagesurface_slot_s &slot = s->stagesurface[s->stagesurface_ix];
+	if (!slot.surface ||
+			width != gs_stagesurface_get_width(slot.surface) ||
+			height != gs_stagesurface_get_height(slot.surface) ||
+			s->scaled_format != gs_stagesurface_get_color_format(slot.surface) ) {
+		gs_stagesurface_destroy(slot.surface);
+		slot.surface = gs_stagesurface_create(width, height, s->scaled_format);
 	}
 
-	gs_stage_texture(s->stagesurface, tex);
+	gs_stage_texture(slot.surface, tex);
+	slot.tick = s->ftm->tick_cnt;
+	slot.scale = scale;
+	slot.staged = true;
+	s->stagesurface_ix = (s->stagesurface_ix + 1) % N_STAGESURFACE;
 
 	return 0;
 }
 
-static inline std::shared_ptr<texture_object> surface_to_cvtex(struct face_tracker_filter *s, float scale)
+static inline void stage_frame(struct face_tracker_filter *s)
+{
+	// Skip scaling and staging if all the workers are still busy.
+	if (!s->ftm->is_frame_needed())
+		return;
+
+	if (s->ftm->scale < 1.0f)
+		s->ftm->scale = 1.0f;
+	const float scale = s->ftm->scale;
+	scale_texture(s, scale);
+	stage_to_surface(s, scale);
+}
+
+static inline std::shared_ptr<texture_object> surface_to_cvtex(struct face_tracker_filter *s)
 {
+	// Read back the surface staged at the previous frame so that the copy on GPU has been done
+	// and mapping it won't stall the rendering pipeline.
+	const int ix = (s->stagesurface_ix + N_STAGESURFACE - 1) % N_STAGESURFACE;
+	struct stagesurface_slot_s &slot = s->stagesurface[ix];
+	if (!slot.staged)
+		return NULL;
+
+	const int latency = s->ftm->tick_cnt - slot.tick;
+	if (latency <= 0)
+		return NULL;
+	if (latency > 1) {
+		// Staging was skipped while all the workers were busy. Don't hand the old frame to the worker
+		// that has become idle; it will take the frame staged at this frame instead.
+		blog(LOG_DEBUG, "face-tracker: skipping the frame staged %d frames ago", latency);
+		slot.staged = false;
+		return NULL;
+	}
+
 	uint8_t *video_data = NULL;
 	uint32_t video_linesize;
-	if (!gs_stagesurface_map(s->stagesurface, &video_data, &video_linesize))
+	if (!gs_stagesurface_map(slot.surface, &video_data, &video_linesize))
 		return NULL;
 
-	uint32_t width = gs_stagesurface_get_width(s->stagesurface);
-	uint32_t height = gs_stagesurface_get_height(s->stagesurface);
+	uint32_t width = gs_stagesurface_get_width(slot.surface);
+	uint32_t height = gs_stagesurface_get_height(slot.surface);
 
 	std::shared_ptr<texture_object> cvtex(new texture_object);
-	cvtex.get()->scale = scale;
-	cvtex.get()->tick = s->ftm->tick_cnt;
+	cvtex.get()->scale = slot.scale;
+	cvtex.get()->tick = slot.tick;
+	cvtex.get()->latency = latency;
 
 	struct obs_source_frame frame;
 	memset(&frame, 0, sizeof(frame));
@@ -751,10 +843,10 @@ static inline std::shared_ptr<texture_object> surface_to_cvtex(struct face_track
 	frame.linesize[0] = video_linesize;
 	frame.width = width;
 	frame.height = height;
-	frame.format = VIDEO_FORMAT_BGRA;
+	frame.format = gs_stagesurface_get_color_format(slot.surface) == GS_R8 ? VIDEO_FORMAT_Y800 : VIDEO_FORMAT_BGRA;
 	cvtex.get()->set_texture_obsframe(&frame, 1);
 
-	gs_stagesurface_unmap(s->stagesurface);
+	gs_stagesurface_unmap(slot.surface);
 
 	return cvtex;
 }
@@ -834,8 +926,8 @@ static inline void draw_frame_info(struct face_tracker_filter *s, bool debug_not
 		}
 
 		gs_effect_set_color(gs_effect_get_param_by_name(effect, "color"), 0xFF00FF00);
-		for (size_t i = 0; i < s->ftm->tracker_rects.size(); i++) {
-			const auto &tr = s->ftm->tracker_rects[i];
+		for (size_t i = 0; i < s->ftm->tracker_rects->size(); i++) {
+			const auto &tr = (*s->ftm->tracker_rects)[i];
 			if (draw_trk)
 				draw_rect_upsize(tr.rect);
 			if (draw_lmk && tr.landmark.size())
@@ -903,8 +995,10 @@ static void ftf_render(void *data, gs_effect_t *)
 
 	if (!s->rendered) {
 		render_target(s, target, parent);
-		if (!s->is_paused)
+		if (!s->is_paused) {
 			s->ftm->post_render();
+			stage_frame(s);
+		}
 		s->rendered = true;
 	}
 
@@ -925,8 +1019,10 @@ static void fts_render(void *data, gs_effect_t *)
 	if (!s->rendered) {
 		s->rendered = true;
 		render_target(s, target, NULL);
-		if (!s->is_paused)
+		if (!s->is_paused) {
 			s->ftm->post_render();
+			stage_frame(s);
+		}
 	}
 
 	draw_frame(s);
@@ -982,6 +1078,8 @@ static void cb_get_state(void *data, calldata_t *cd)
 {
 	auto *s = (struct face_tracker_filter*)data;
 	calldata_set_bool(cd, "paused", s->is_paused);
+	calldata_set_float(cd, "tracking_rate", s->ftm->tracking_rate_measured);
+	calldata_set_float(cd, "tracking_rate_limit", s->ftm->tracking_rate_eff);
 }
 
 static void cb_set_state(void *data, calldata_t *cd)
@@ -1003,7 +1101,7 @@ static void cb_set_state(void *data, calldata_t *cd)
 static void emit_state_changed(struct face_tracker_filter *s)
 {
 	struct calldata cd;
-	uint8_t stack[128];
+	uint8_t stack[256];
 
 	calldata_init_fixed(&cd, stack, sizeof(stack));
 	calldata_set_ptr(&cd, "source", s->context);
@@ -1030,6 +1128,8 @@ void register_face_tracker_filter(bool hide_filter, bool hide_source)
 	info.get_defaults = ftf_get_defaults;
 	info.activate = ftf_activate,
 	info.deactivate = ftf_deactivate,
+	info.show = ftf_show,
+	info.hide = ftf_hide,
 	info.video_tick = ftf_tick;
 	info.video_render = ftf_render;
 	info.get_width = ftf_width;
@@ -4,12 +4,27 @@
 #include <deque>
 #include "helper.hpp"
 
+#define N_STAGESURFACE 2
+
+struct stagesurface_slot_s
+{
+	gs_stagesurf_t *surface;
+	int tick; // tick_cnt when the texture was staged
+	float scale;
+	bool staged;
+};
+
 struct face_tracker_filter
 {
 	obs_source_t *context;
 	gs_texrender_t *texrender;
 	gs_texrender_t *texrender_scaled;
-	gs_stagesurf_t *stagesurface;
+	enum gs_color_format scaled_format;
+	gs_effect_t *effect_luma;
+	bool effect_luma_failed;
+	bool readback_luma;
+	struct stagesurface_slot_s stagesurface[N_STAGESURFACE];
+	int stagesurface_ix; // slot to be staged next
 	uint32_t known_width;
 	uint32_t known_height;
 	uint32_t width_with_aspect;
@@ -17,6 +32,7 @@ struct face_tracker_filter
 	bool target_valid;
 	bool rendered;
 	bool is_active;
+	bool is_showing;
 
 	f3 detect_err;
 	f3 range_min, range_max, range_min_out;
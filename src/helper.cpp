@@ -33,7 +33,7 @@ void draw_rect_upsize(rect_s r, float upsize_l, float upsize_r, float upsize_t,
 	gs_render_stop(GS_LINES);
 }
 
-float landmark_area(const std::vector<pointf_s> &landmark)
+float landmark_area(const pointf_span_s &landmark)
 {
 	// TODO: implement area calculation for other models
 	// Maybe, use the area of the maximum convex polygon.
@@ -73,7 +73,7 @@ float landmark_area(const std::vector<pointf_s> &landmark)
 	return ret;
 }
 
-pointf_s landmark_center(const std::vector<pointf_s> &landmark)
+pointf_s landmark_center(const pointf_span_s &landmark)
 {
 	pointf_s ret = {0.0f, 0.0f};
 
@@ -88,7 +88,7 @@ pointf_s landmark_center(const std::vector<pointf_s> &landmark)
 	return ret;
 }
 
-void draw_landmark(const std::vector<pointf_s> &landmark)
+void draw_landmark(const pointf_span_s &landmark)
 {
 	if (landmark.size() < 2)
 		return;
@@ -16,6 +16,19 @@ struct pointf_s
 	float y;
 };
 
+/* Read-only view of landmark points, usable for both std::vector and arenas. */
+struct pointf_span_s
+{
+	const pointf_s *data;
+	size_t n;
+
+	pointf_span_s() : data(NULL), n(0) {}
+	pointf_span_s(const pointf_s *data_, size_t n_) : data(data_), n(n_) {}
+	pointf_span_s(const std::vector<pointf_s> &v) : data(v.data()), n(v.size()) {}
+	size_t size() const { return n; }
+	const pointf_s &operator[](size_t i) const { return data[i]; }
+};
+
 struct rect_s
 {
 	int x0;
@@ -74,6 +87,20 @@ static inline int common_area(const rect_s &a, const rect_s &b)
 	return common_length(a.x0, a.x1, b.x0, b.x1) * common_length(a.y0, a.y1, b.y0, b.y1);
 }
 
+static inline int get_area(const rect_s &r)
+{
+	return (r.x1 - r.x0) * (r.y1 - r.y0);
+}
+
+static inline float iou(const rect_s &a, const rect_s &b)
+{
+	int c = common_area(a, b);
+	int u = get_area(a) + get_area(b) - c;
+	if (u <= 0)
+		return 0.0f;
+	return (float)c / u;
+}
+
 template <typename T> static inline bool samesign(const T &a, const T &b)
 {
 	if (a>0 && b>0)
@@ -99,9 +126,9 @@ static inline rectf_s f3_to_rectf(const f3 &u, float w, float h)
 }
 
 void draw_rect_upsize(rect_s r, float upsize_l=0.0f, float upsize_r=0.0f, float upsize_t=0.0f, float upsize_b=0.0f);
-void draw_landmark(const std::vector<pointf_s> &landmark);
-float landmark_area(const std::vector<pointf_s> &landmark);
-pointf_s landmark_center(const std::vector<pointf_s> &landmark);
+void draw_landmark(const pointf_span_s &landmark);
+float landmark_area(const pointf_span_s &landmark);
+pointf_s landmark_center(const pointf_span_s &landmark);
 
 inline double from_dB(double x)
 {
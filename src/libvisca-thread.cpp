@@ -1,27 +1,63 @@
 #include <obs-module.h>
 #include <util/platform.h>
 #include <util/threading.h>
-#include <graphics/vec2.h>
-#include <graphics/graphics.h>
 #include <climits>
 #include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#ifndef _WIN32
+#include <netinet/tcp.h>
+#endif
 #include "plugin-macros.generated.h"
 #include "libvisca-thread.hpp"
-#include "libvisca.h"
 
 #define debug(...) blog(LOG_INFO, __VA_ARGS__)
 
+#define ZOOM_POLL_MIN_MS 20
+#define ZOOM_POLL_DEFAULT_MS 100
+#define RECONNECT_WAIT_MS 50
+#define RECEIVE_SLICE_MS 5 // While a socket is free, new requests are checked at this interval.
+#define WAIT_MAX_MS 250 // The thread also wakes up at this interval to check it is still referenced.
+#define REPLY_TIMEOUT_SHIFT 3 // The camera is considered not responding after 8 times of the timeout.
+#define COMPLETION_TIMEOUT_NS 10000000000ULL // A preset recall completes after the camera stops.
+
 libvisca_thread::libvisca_thread()
 {
 	debug("libvisca_thread::libvisca_thread");
-	iface = NULL;
-	camera = NULL;
+#ifdef _WIN32
+	WSADATA wsa;
+	WSAStartup(MAKEWORD(2, 2), &wsa);
+#endif
 	data = NULL;
+	data_changed = false;
+	preset_changed = false;
 	pan_rsvd = 0;
 	tilt_rsvd = 0;
 	zoom_rsvd = 0;
+	preset_rsvd = 0;
 	zoom_got = 0;
+	zoom_poll_ms = ZOOM_POLL_DEFAULT_MS;
+	pantilt_pos_mode = false;
+	zoom_pos_mode = false;
+	pantilt_pos_rsvd = ptz_position_request_s();
+	zoom_pos_rsvd = 0;
+	zoom_pos_cnt = 0;
+	position_wanted = false;
+	position_got_valid = false;
+	pan_got = 0;
+	tilt_got = 0;
+	sock = VISCA_IP_INVALID_SOCKET;
+	rx_len = 0;
+	next_send_ns = 0;
+	n_inflight = 0;
+	n_inquiry = 0;
+	pan_sent = tilt_sent = zoom_sent = INT_MIN;
+	pantilt_pos_sent = 0;
+	zoom_pos_sent = 0;
+	zoom_poll_next_ns = 0;
+	position_poll_next_ns = 0;
 	pthread_mutex_init(&mutex, 0);
+	os_event_init(&event, OS_EVENT_TYPE_AUTO);
 
 	pthread_create(&thread, NULL, libvisca_thread::thread_main, (void*)this);
 	pthread_detach(thread);
@@ -29,52 +65,91 @@ libvisca_thread::libvisca_thread()
 
 libvisca_thread::~libvisca_thread()
 {
-	if (iface) {
-		VISCA_close(iface);
-		bfree(iface);
-	}
-	if (camera)
-		bfree(camera);
+	if (sock != VISCA_IP_INVALID_SOCKET)
+		visca_ip_closesocket(sock);
 	if (data)
 		obs_data_release(data);
+	os_event_destroy(event);
 	pthread_mutex_destroy(&mutex);
+#ifdef _WIN32
+	WSACleanup();
+#endif
+}
+
+void libvisca_thread::thread_disconnect()
+{
+	if (sock != VISCA_IP_INVALID_SOCKET) {
+		visca_ip_closesocket(sock);
+		sock = VISCA_IP_INVALID_SOCKET;
+	}
+	rx_len = 0;
+	while (n_inflight > 0)
+		remove_inflight(n_inflight - 1, true);
+	n_inquiry = 0;
 }
 
 void libvisca_thread::thread_connect()
 {
 	pthread_mutex_lock(&mutex);
-
-	const char *address = obs_data_get_string(data, "address");
+	char *address = bstrdup(obs_data_get_string(data, "address"));
 	int port = (int)obs_data_get_int(data, "port");
-	auto *iface_new = (struct _VISCA_interface*)bzalloc(sizeof(struct _VISCA_interface));
-	debug("libvisca_thread::thread_connect connecting to address=%s port=%d...", address, port);
-	if (VISCA_open_tcp(iface_new, address, port) != VISCA_SUCCESS) {
-		blog(LOG_ERROR, "failed to connect %s:%d", address, port);
-		bfree(iface_new);
-		iface_new = NULL;
-	}
-	debug("libvisca_thread::thread_connect connected.");
+	data_changed = false;
 	pthread_mutex_unlock(&mutex);
-	if (!iface_new)
+
+	thread_disconnect();
+
+	char port_str[8];
+	snprintf(port_str, sizeof(port_str), "%d", port);
+	struct addrinfo hints = {};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	struct addrinfo *res = NULL;
+	debug("libvisca_thread::thread_connect connecting to address=%s port=%d...", address, port);
+	if (getaddrinfo(address, port_str, &hints, &res) != 0 || !res) {
+		blog(LOG_ERROR, "failed to resolve %s:%d", address, port);
+		bfree(address);
 		return;
+	}
 
-	if (iface) {
-		VISCA_close(iface);
-		bfree(iface);
+	for (struct addrinfo *ai = res; ai; ai = ai->ai_next) {
+		visca_ip_socket_t s = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (s == VISCA_IP_INVALID_SOCKET)
+			continue;
+		if (connect(s, ai->ai_addr, (int)ai->ai_addrlen) == 0) {
+			sock = s;
+			break;
+		}
+		visca_ip_closesocket(s);
 	}
-	iface = iface_new;
-	if (!camera)
-		camera = (VISCACamera_t*)bzalloc(sizeof(VISCACamera_t));
-	data_changed = false;
+	freeaddrinfo(res);
+
+	if (sock == VISCA_IP_INVALID_SOCKET) {
+		blog(LOG_ERROR, "failed to connect %s:%d", address, port);
+		bfree(address);
+		return;
+	}
+	bfree(address);
 
-	debug("libvisca_thread::thread_connect sending VISCA_clear...");
-	camera->address = 1;
-	VISCA_clear(iface, camera);
+	// The messages are short; don't let them wait for the acknowledgment of the previous segment.
+	int nodelay = 1;
+	setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char *)&nodelay, sizeof(nodelay));
+
+	rtt.reset();
+	next_send_ns = 0;
+	pan_sent = tilt_sent = zoom_sent = INT_MIN;
+	zoom_poll_next_ns = 0;
+	position_poll_next_ns = 0;
+
+	// IF_Clear cancels the commands left in the camera.
+	debug("libvisca_thread::thread_connect sending IF_Clear...");
+	const uint8_t p[] = {0x81, 0x01, 0x00, 0x01, 0xFF};
+	send_inquiry(inquiry_kind_clear, p, sizeof(p));
 	debug("libvisca_thread::thread_connect exiting successfully");
 }
 
 void *libvisca_thread::thread_main(void *data)
 {
+	os_set_thread_name("libvisca");
 	auto *visca = (libvisca_thread*)data;
 	visca->add_ref();
 	visca->thread_loop();
@@ -82,95 +157,479 @@ void *libvisca_thread::thread_main(void *data)
 	return NULL;
 }
 
-static inline void send_pantilt(struct _VISCA_interface *iface, struct _VISCA_camera *camera, int pan, int tilt)
-{
-	debug("send_pantilt moving pan=%d tilt=%d", pan, tilt);
-	int pan_a = abs(pan);
-	int tilt_a = abs(tilt);
-	if (pan_a>127) pan_a = 127;
-	if (tilt_a>127) tilt_a = 127;
-	if      (tilt<0 && pan<0) // 1=up, 1=left
-		VISCA_set_pantilt_upleft(iface, camera, pan_a, tilt_a);
-	else if (tilt<0 && pan==0) // 1=up
-		VISCA_set_pantilt_up(iface, camera, pan_a, tilt_a);
-	else if (tilt<0 && pan>0) // 1=up, 2=right
-		VISCA_set_pantilt_upright(iface, camera, pan_a, tilt_a);
-	else if (tilt==0 && pan<0) // 1=left
-		VISCA_set_pantilt_left(iface, camera, pan_a, tilt_a);
-	else if (tilt==0 && pan==0)
-		VISCA_set_pantilt_stop(iface, camera, pan_a, tilt_a);
-	else if (tilt==0 && pan>0) // 2=right
-		VISCA_set_pantilt_right(iface, camera, pan_a, tilt_a);
-	else if (tilt>0 && pan<0) // 2=down, 1=left
-		VISCA_set_pantilt_downleft(iface, camera, pan_a, tilt_a);
-	else if (tilt>0 && pan==0) // 2=down
-		VISCA_set_pantilt_down(iface, camera, pan_a, tilt_a);
-	else if (tilt>0 && pan>0)
-		VISCA_set_pantilt_downright(iface, camera, pan_a, tilt_a);
-}
-
-static inline void send_zoom(struct _VISCA_interface *iface, struct _VISCA_camera *camera, int zoom)
-{
-	debug("send_zoom moving zoom=%d", zoom);
-	int zoom_a = std::abs(zoom);
-	if (zoom_a > 7) zoom_a = 7;
-	// zoom>0 : wide
-	if (zoom>0)
-		VISCA_set_zoom_wide_speed(iface, camera, zoom_a);
-	else if (zoom<0)
-		VISCA_set_zoom_tele_speed(iface, camera, zoom_a);
-	else
-		VISCA_set_zoom_stop(iface, camera);
+bool libvisca_thread::send_message(const uint8_t *p, size_t len)
+{
+	while (len > 0) {
+		int n = (int)send(sock, (const char *)p, (int)len, 0);
+		if (n <= 0)
+			return false;
+		p += n;
+		len -= (size_t)n;
+	}
+	return true;
 }
 
-void libvisca_thread::thread_loop()
+bool libvisca_thread::is_inflight(cmd_kind_e kind) const
 {
-	int pan_prev=INT_MIN, tilt_prev=INT_MIN, zoom_prev=INT_MIN;
+	for (int i = 0; i < n_inflight; i++) {
+		if (inflight[i].kind == kind)
+			return true;
+	}
+	return false;
+}
 
-	while (get_ref() > 1) {
-		if (data_changed) {
-			thread_connect();
-			pan_prev=INT_MIN;
-			tilt_prev=INT_MIN;
-			zoom_prev=INT_MIN;
+bool libvisca_thread::is_inquired(inquiry_kind_e kind) const
+{
+	for (int i = 0; i < n_inquiry; i++) {
+		if (inquiry[i].kind == kind)
+			return true;
+	}
+	return false;
+}
+
+libvisca_thread::inflight_s &libvisca_thread::send_command(cmd_kind_e kind, const uint8_t *p, size_t len)
+{
+	inflight_s &f = inflight[n_inflight++];
+	f.kind = kind;
+	f.socket = 0;
+	f.sent_ns = os_gettime_ns();
+	f.position = false;
+	f.relative = false;
+	f.cnt = 0;
+	if (!send_message(p, len))
+		blog(LOG_WARNING, "libvisca_thread: failed to send a message");
+	return f;
+}
+
+void libvisca_thread::send_inquiry(inquiry_kind_e kind, const uint8_t *p, size_t len)
+{
+	inquiry_s &q = inquiry[n_inquiry++];
+	q.kind = kind;
+	q.sent_ns = os_gettime_ns();
+	if (!send_message(p, len))
+		blog(LOG_WARNING, "libvisca_thread: failed to send a message");
+}
+
+static inline int clamp_speed(int v, int max)
+{
+	return v < 1 ? 1 : v > max ? max : v;
+}
+
+/*
+ * Sends one message if a socket of the camera is free.
+ * The speeds are read just before sending so that the requests
+ * that arrived while the sockets are busy are coalesced into the latest one.
+ */
+bool libvisca_thread::send_next(uint64_t ns)
+{
+	if (ns < next_send_ns)
+		return false;
+
+	if (n_inflight < 2) {
+		if (!is_inflight(cmd_kind_preset) && os_atomic_exchange_bool(&preset_changed, false)) {
+			const uint8_t p[] = {0x81, 0x01, 0x04, 0x3F, 0x02, (uint8_t)(preset_rsvd & 0x7F), 0xFF};
+			send_command(cmd_kind_preset, p, sizeof(p));
+			return true;
 		}
-		if (!iface) {
-			os_sleep_ms(50);
-			continue;
+
+		if (os_atomic_load_bool(&pantilt_pos_mode)) {
+			pthread_mutex_lock(&mutex);
+			ptz_position_request_s req = pantilt_pos_rsvd;
+			pthread_mutex_unlock(&mutex);
+			if (!is_inflight(cmd_kind_pantilt) && req.cnt != pantilt_pos_sent) {
+				uint8_t p[15] = {0x81, 0x01, 0x06, (uint8_t)(req.relative ? 0x03 : 0x02),
+					(uint8_t)clamp_speed(req.speed_pan, 0x18), (uint8_t)clamp_speed(req.speed_tilt, 0x17)};
+				visca_int_to_nibbles(p + 6, req.pan & 0xFFFF, 4);
+				visca_int_to_nibbles(p + 10, req.tilt & 0xFFFF, 4);
+				p[14] = 0xFF;
+				inflight_s &f = send_command(cmd_kind_pantilt, p, sizeof(p));
+				f.position = true;
+				f.relative = req.relative;
+				f.cnt = (long)req.cnt;
+				pantilt_pos_sent = req.cnt;
+				pan_sent = tilt_sent = INT_MIN; // the next speed has to be sent even if unchanged
+				return true;
+			}
 		}
-		int pan = os_atomic_load_long(&pan_rsvd);
-		int tilt = os_atomic_load_long(&tilt_rsvd);
-		int zoom = os_atomic_load_long(&zoom_rsvd);
-		bool ptz_changed = false;
-		if (pan!=pan_prev || tilt!=tilt_prev) {
-			send_pantilt(iface, camera, pan, tilt);
-			pan_prev = pan;
-			tilt_prev = tilt;
-			ptz_changed = true;
+		else {
+			int pan = os_atomic_load_long(&pan_rsvd);
+			int tilt = os_atomic_load_long(&tilt_rsvd);
+			if (!is_inflight(cmd_kind_pantilt) && (pan != pan_sent || tilt != tilt_sent)) {
+				const uint8_t p[] = {
+					0x81, 0x01, 0x06, 0x01,
+					(uint8_t)clamp_speed(std::abs(pan), 0x18),
+					(uint8_t)clamp_speed(std::abs(tilt), 0x17),
+					(uint8_t)(pan < 0 ? 0x01 : pan > 0 ? 0x02 : 0x03), // 1=left, 2=right
+					(uint8_t)(tilt < 0 ? 0x01 : tilt > 0 ? 0x02 : 0x03), // 1=up, 2=down
+					0xFF,
+				};
+				send_command(cmd_kind_pantilt, p, sizeof(p));
+				pan_sent = pan;
+				tilt_sent = tilt;
+				return true;
+			}
+		}
+
+		if (os_atomic_load_bool(&zoom_pos_mode)) {
+			long cnt = os_atomic_load_long(&zoom_pos_cnt);
+			if (!is_inflight(cmd_kind_zoom) && cnt != zoom_pos_sent) {
+				uint8_t p[9] = {0x81, 0x01, 0x04, 0x47};
+				visca_int_to_nibbles(p + 4, (int)os_atomic_load_long(&zoom_pos_rsvd) & 0xFFFF, 4);
+				p[8] = 0xFF;
+				inflight_s &f = send_command(cmd_kind_zoom, p, sizeof(p));
+				f.position = true;
+				f.cnt = cnt;
+				zoom_pos_sent = cnt;
+				zoom_sent = INT_MIN;
+				return true;
+			}
 		}
-		if (zoom!=zoom_prev) {
-			send_zoom(iface, camera, zoom);
-			zoom_prev = zoom;
-			ptz_changed = true;
+		else {
+			int zoom = os_atomic_load_long(&zoom_rsvd);
+			if (!is_inflight(cmd_kind_zoom) && zoom != zoom_sent) {
+				int zoom_a = std::abs(zoom);
+				if (zoom_a > 7) zoom_a = 7;
+				// zoom>0 : wide
+				const uint8_t p[] = {0x81, 0x01, 0x04, 0x07, (uint8_t)(zoom > 0 ? 0x30 | zoom_a : zoom < 0 ? 0x20 | zoom_a : 0x00), 0xFF};
+				send_command(cmd_kind_zoom, p, sizeof(p));
+				zoom_sent = zoom;
+				return true;
+			}
 		}
+	}
+
+	// Zoom is polled at its own interval regardless of how often the speed is requested.
+	if (!is_inquired(inquiry_kind_zoom) && ns >= zoom_poll_next_ns) {
+		const uint8_t p[] = {0x81, 0x09, 0x04, 0x47, 0xFF};
+		send_inquiry(inquiry_kind_zoom, p, sizeof(p));
+		zoom_poll_next_ns = ns + os_atomic_load_long(&zoom_poll_ms) * 1000000ULL;
+		return true;
+	}
+
+	// The position is inquired only after someone is interested in it.
+	if (os_atomic_load_bool(&position_wanted) && !is_inquired(inquiry_kind_position) && ns >= position_poll_next_ns) {
+		const uint8_t p[] = {0x81, 0x09, 0x06, 0x12, 0xFF};
+		send_inquiry(inquiry_kind_position, p, sizeof(p));
+		position_poll_next_ns = ns + os_atomic_load_long(&zoom_poll_ms) * 1000000ULL;
+		return true;
+	}
 
-		if (os_atomic_load_bool(&preset_changed)) {
-			os_sleep_ms(48);
-			VISCA_memory_recall(iface, camera, preset_rsvd);
-			os_sleep_ms(48);
+	return false;
+}
+
+// Returns true if a command is waiting for a free socket.
+bool libvisca_thread::has_pending()
+{
+	if (os_atomic_load_bool(&preset_changed) && !is_inflight(cmd_kind_preset))
+		return true;
+	if (!is_inflight(cmd_kind_pantilt)) {
+		if (os_atomic_load_bool(&pantilt_pos_mode)) {
+			pthread_mutex_lock(&mutex);
+			unsigned int cnt = pantilt_pos_rsvd.cnt;
+			pthread_mutex_unlock(&mutex);
+			if (cnt != pantilt_pos_sent)
+				return true;
 		}
+		else if (os_atomic_load_long(&pan_rsvd) != pan_sent || os_atomic_load_long(&tilt_rsvd) != tilt_sent)
+			return true;
+	}
+	if (!is_inflight(cmd_kind_zoom)) {
+		if (os_atomic_load_bool(&zoom_pos_mode)) {
+			if (os_atomic_load_long(&zoom_pos_cnt) != zoom_pos_sent)
+				return true;
+		}
+		else if (os_atomic_load_long(&zoom_rsvd) != zoom_sent)
+			return true;
+	}
+	return false;
+}
 
-		uint16_t zoom_cur = 0;
-		if (VISCA_get_zoom_value(iface, camera, &zoom_cur) == VISCA_SUCCESS) {
-			os_atomic_set_long(&zoom_got, (long)zoom_cur);
-			debug("libvisca_thread::thread_loop got zoom=%d", (int)zoom_cur);
+void libvisca_thread::remove_inflight(int i, bool failed)
+{
+	/* If failed, the latest request of the same kind will be sent again.
+	 * An absolute position move is sent again only if no later move has been sent.
+	 * A relative move is not sent again since the camera might have moved by it. */
+	const inflight_s &f = inflight[i];
+	if (failed) {
+		switch (f.kind) {
+			case cmd_kind_pantilt:
+				if (!f.position)
+					pan_sent = tilt_sent = INT_MIN;
+				else if (!f.relative && pantilt_pos_sent == (unsigned int)f.cnt)
+					pantilt_pos_sent--;
+				break;
+			case cmd_kind_zoom:
+				if (!f.position)
+					zoom_sent = INT_MIN;
+				else if (zoom_pos_sent == f.cnt)
+					zoom_pos_sent--;
+				break;
+			case cmd_kind_preset:
+				os_atomic_set_bool(&preset_changed, true);
+				break;
+			default:
+				break;
 		}
+	}
+	inflight[i] = inflight[--n_inflight];
+}
 
-		if (!ptz_changed)
-			os_sleep_ms(50);
+void libvisca_thread::remove_inquiry(int i)
+{
+	// Keep the order; the replies are matched to the oldest inquiry.
+	for (n_inquiry--; i < n_inquiry; i++)
+		inquiry[i] = inquiry[i + 1];
+}
+
+void libvisca_thread::handle_reply(const uint8_t *p, size_t len, uint64_t ns)
+{
+	if (len < 3)
+		return;
+	const int socket = p[1] & 0x0F;
+
+	// The oldest command not yet acknowledged
+	int i_unacked = -1;
+	for (int i = 0; i < n_inflight; i++) {
+		if (!inflight[i].socket && (i_unacked < 0 || inflight[i].sent_ns < inflight[i_unacked].sent_ns))
+			i_unacked = i;
+	}
+	int i_socket = -1;
+	for (int i = 0; socket && i < n_inflight; i++) {
+		if (inflight[i].socket == socket)
+			i_socket = i;
+	}
+
+	switch (p[1] & 0xF0) {
+		case VISCA_REPLY_ACK:
+			if (i_unacked < 0)
+				return;
+			rtt.update((int64_t)(ns - inflight[i_unacked].sent_ns));
+			inflight[i_unacked].socket = socket;
+			// A position move runs until the camera arrives. Let the next request replace it.
+			// Its completion does not match any entry and is ignored.
+			if (inflight[i_unacked].position)
+				remove_inflight(i_unacked, false);
+			break;
+
+		case VISCA_REPLY_COMPLETION:
+			if (i_socket >= 0) {
+				remove_inflight(i_socket, false);
+				return;
+			}
+			if (socket || !n_inquiry)
+				return;
+			rtt.update((int64_t)(ns - inquiry[0].sent_ns));
+			if (inquiry[0].kind == inquiry_kind_zoom && len >= 7) {
+				int zoom_cur = visca_nibbles_to_int(p + 2, 4);
+				os_atomic_set_long(&zoom_got, zoom_cur);
+			}
+			if (inquiry[0].kind == inquiry_kind_position && len >= 11) {
+				os_atomic_set_long(&pan_got, (int16_t)visca_nibbles_to_int(p + 2, 4));
+				os_atomic_set_long(&tilt_got, (int16_t)visca_nibbles_to_int(p + 6, 4));
+				os_atomic_set_bool(&position_got_valid, true);
+			}
+			remove_inquiry(0);
+			break;
+
+		case VISCA_REPLY_ERROR: {
+			const uint8_t error = len >= 4 ? p[2] : 0;
+			const bool busy = error == VISCA_ERROR_BUFFER_FULL || error == VISCA_ERROR_NO_SOCKET;
+			if (busy) {
+				// The camera is busy, wait longer before sending the next message.
+				next_send_ns = ns + rtt.timeout_ns();
+			}
+			else {
+				// Retrying does not help, e.g. zoom at its end.
+				debug("libvisca_thread: camera returned error %02x", error);
+			}
+
+			if (i_socket >= 0) {
+				remove_inflight(i_socket, false);
+				return;
+			}
+			// An error without the socket is for the oldest message that is not acknowledged.
+			if (i_unacked >= 0 && (!n_inquiry || inflight[i_unacked].sent_ns < inquiry[0].sent_ns))
+				remove_inflight(i_unacked, busy);
+			else if (n_inquiry)
+				remove_inquiry(0);
+			break;
+		}
+	}
+}
+
+void libvisca_thread::receive(uint64_t timeout_ns)
+{
+	struct timeval tv;
+	tv.tv_sec = (long)(timeout_ns / 1000000000);
+	tv.tv_usec = (long)(timeout_ns % 1000000000 / 1000);
+
+	for (;;) {
+		fd_set fds;
+		FD_ZERO(&fds);
+		FD_SET(sock, &fds);
+		if (select((int)sock + 1, &fds, NULL, NULL, &tv) <= 0)
+			return;
+
+		int n = (int)recv(sock, (char *)rx_buf + rx_len, (int)(sizeof(rx_buf) - rx_len), 0);
+		if (n <= 0) {
+			blog(LOG_WARNING, "libvisca_thread: connection closed by the camera, reconnecting");
+			thread_disconnect();
+			data_changed = true;
+			return;
+		}
+		rx_len += (size_t)n;
+
+		const uint64_t ns = os_gettime_ns();
+		size_t start = 0;
+		for (size_t i = 0; i < rx_len; i++) {
+			if (rx_buf[i] != 0xFF)
+				continue;
+			handle_reply(rx_buf + start, i + 1 - start, ns);
+			start = i + 1;
+		}
+		if (start == 0 && rx_len == sizeof(rx_buf))
+			start = rx_len; // not a VISCA message
+		memmove(rx_buf, rx_buf + start, rx_len - start);
+		rx_len -= start;
+
+		// Drain the other replies without waiting.
+		tv.tv_sec = 0;
+		tv.tv_usec = 0;
+	}
+}
+
+/*
+ * Gives up the commands the camera does not complete.
+ * If the camera does not reply at all, the replies cannot be matched any more; connect again,
+ * which also clears the commands left in the camera.
+ */
+void libvisca_thread::expire(uint64_t ns)
+{
+	const uint64_t reply_timeout_ns = rtt.timeout_ns() << REPLY_TIMEOUT_SHIFT;
+
+	// Some cameras don't reply to IF_Clear.
+	if (n_inquiry > 0 && inquiry[0].kind == inquiry_kind_clear && ns >= inquiry[0].sent_ns + reply_timeout_ns)
+		remove_inquiry(0);
+
+	bool no_reply = n_inquiry > 0 && ns >= inquiry[0].sent_ns + reply_timeout_ns;
+
+	for (int i = n_inflight - 1; i >= 0; i--) {
+		inflight_s &f = inflight[i];
+		if (f.socket) {
+			if (ns >= f.sent_ns + COMPLETION_TIMEOUT_NS)
+				remove_inflight(i, false);
+		}
+		else if (ns >= f.sent_ns + reply_timeout_ns)
+			no_reply = true;
+	}
+
+	if (no_reply) {
+		blog(LOG_WARNING, "libvisca_thread: no reply from the camera, reconnecting");
+		thread_disconnect();
+		data_changed = true;
+	}
+}
+
+void libvisca_thread::thread_loop()
+{
+	while (get_ref() > 1) {
+		if (data_changed)
+			thread_connect();
+		if (sock == VISCA_IP_INVALID_SOCKET) {
+			os_event_timedwait(event, RECONNECT_WAIT_MS);
+			continue;
+		}
+
+		uint64_t ns = os_gettime_ns();
+		while (send_next(ns))
+			ns = os_gettime_ns();
+		expire(ns);
+		if (sock == VISCA_IP_INVALID_SOCKET)
+			continue;
+
+		uint64_t wake_ns = ns + WAIT_MAX_MS * 1000000ULL;
+		uint64_t t = is_inquired(inquiry_kind_zoom) ? wake_ns : zoom_poll_next_ns;
+		if (os_atomic_load_bool(&position_wanted) && !is_inquired(inquiry_kind_position) && position_poll_next_ns < t)
+			t = position_poll_next_ns;
+		if (n_inflight < 2 && has_pending())
+			t = ns;
+		if (t < next_send_ns)
+			t = next_send_ns;
+		if (t < wake_ns)
+			wake_ns = t;
+		const uint64_t reply_timeout_ns = rtt.timeout_ns() << REPLY_TIMEOUT_SHIFT;
+		for (int i = 0; i < n_inflight; i++) {
+			t = inflight[i].sent_ns + (inflight[i].socket ? COMPLETION_TIMEOUT_NS : reply_timeout_ns);
+			if (t < wake_ns)
+				wake_ns = t;
+		}
+		for (int i = 0; i < n_inquiry; i++) {
+			t = inquiry[i].sent_ns + reply_timeout_ns;
+			if (t < wake_ns)
+				wake_ns = t;
+		}
+		uint64_t wait_ns = wake_ns > ns ? wake_ns - ns : 0;
+		if (wait_ns < 1000000ULL)
+			wait_ns = 1000000ULL;
+
+		if (n_inflight > 0 || n_inquiry > 0) {
+			if (n_inflight < 2 && wait_ns > RECEIVE_SLICE_MS * 1000000ULL)
+				wait_ns = RECEIVE_SLICE_MS * 1000000ULL;
+			receive(wait_ns);
+		}
+		else {
+			os_event_timedwait(event, (unsigned long)((wait_ns + 999999) / 1000000));
+		}
 	}
 }
 
+bool libvisca_thread::get_position(int &pan, int &tilt)
+{
+	// The position is inquired only after someone is interested in it.
+	os_atomic_set_bool(&position_wanted, true);
+	if (!os_atomic_load_bool(&position_got_valid))
+		return false;
+	pan = os_atomic_load_long(&pan_got);
+	tilt = os_atomic_load_long(&tilt_got);
+	return true;
+}
+
+void libvisca_thread::move_pantilt_absolute(int pan, int tilt, int speed_pan, int speed_tilt)
+{
+	pthread_mutex_lock(&mutex);
+	pantilt_pos_rsvd.pan = pan;
+	pantilt_pos_rsvd.tilt = tilt;
+	pantilt_pos_rsvd.speed_pan = speed_pan;
+	pantilt_pos_rsvd.speed_tilt = speed_tilt;
+	pantilt_pos_rsvd.relative = false;
+	pantilt_pos_rsvd.cnt++;
+	pthread_mutex_unlock(&mutex);
+	os_atomic_set_bool(&pantilt_pos_mode, true);
+	os_event_signal(event);
+}
+
+void libvisca_thread::move_pantilt_relative(int pan, int tilt, int speed_pan, int speed_tilt)
+{
+	pthread_mutex_lock(&mutex);
+	pantilt_pos_rsvd.pan = pan;
+	pantilt_pos_rsvd.tilt = tilt;
+	pantilt_pos_rsvd.speed_pan = speed_pan;
+	pantilt_pos_rsvd.speed_tilt = speed_tilt;
+	pantilt_pos_rsvd.relative = true;
+	pantilt_pos_rsvd.cnt++;
+	pthread_mutex_unlock(&mutex);
+	os_atomic_set_bool(&pantilt_pos_mode, true);
+	os_event_signal(event);
+}
+
+void libvisca_thread::move_zoom_absolute(int zoom)
+{
+	os_atomic_set_long(&zoom_pos_rsvd, zoom);
+	os_atomic_inc_long(&zoom_pos_cnt);
+	os_atomic_set_bool(&zoom_pos_mode, true);
+	os_event_signal(event);
+}
+
 void libvisca_thread::set_config(struct obs_data *data_)
 {
 	pthread_mutex_lock(&mutex);
@@ -191,5 +650,12 @@ void libvisca_thread::set_config(struct obs_data *data_)
 		data_changed = true;
 	data = data_;
 
+	long ms = (long)obs_data_get_int(data, "zoom_poll_ms");
+	if (ms < ZOOM_POLL_MIN_MS)
+		ms = ms > 0 ? ZOOM_POLL_MIN_MS : ZOOM_POLL_DEFAULT_MS;
+	os_atomic_set_long(&zoom_poll_ms, ms);
+
 	pthread_mutex_unlock(&mutex);
+
+	os_event_signal(event);
 }
@@ -1,25 +1,102 @@
 #pragma once
 
 #include <util/threading.h>
-// #include "libvisca.h"
 #include "ptz-backend.hpp"
+#include "ptz-rtt.hpp"
+#include "visca-ip.hpp"
 
+/*
+ * PTZ backend speaking VISCA over TCP.
+ * The VISCA messages are written to the stream as they are and the replies are split at the terminator 0xFF.
+ * The messages are sent from a thread that keeps at most two commands in flight,
+ * which is the number of command sockets of most cameras.
+ * The stream keeps the order, so the ACK is matched to the oldest command not yet acknowledged
+ * and the completion is matched by the socket number in the ACK.
+ * The inquiries do not take a command socket and their replies are matched in the order sent.
+ * A position move gives up its slot when acknowledged so that it does not block the speeds until it completes.
+ */
 class libvisca_thread : public ptz_backend
 {
+	enum cmd_kind_e
+	{
+		cmd_kind_none = 0,
+		cmd_kind_pantilt,
+		cmd_kind_zoom,
+		cmd_kind_preset,
+	};
+
+	enum inquiry_kind_e
+	{
+		inquiry_kind_clear = 0, // IF_Clear replies in the same form as an inquiry
+		inquiry_kind_zoom,
+		inquiry_kind_position,
+	};
+
+	struct inflight_s
+	{
+		cmd_kind_e kind;
+		int socket; // 0 until acknowledged
+		uint64_t sent_ns;
+		bool position; // position move, which gives up the slot when acknowledged
+		bool relative; // relative position move
+		long cnt; // request count of the position move
+	};
+
+	struct inquiry_s
+	{
+		inquiry_kind_e kind;
+		uint64_t sent_ns;
+	};
+
 	pthread_mutex_t mutex;
 	pthread_t thread;
-	struct _VISCA_interface *iface;
-	struct _VISCA_camera *camera;
+	os_event_t *event; // signaled when a request arrives
 	struct obs_data *data;
 	volatile bool data_changed;
 	volatile bool preset_changed;
 	volatile long pan_rsvd, tilt_rsvd, zoom_rsvd;
 	volatile int preset_rsvd;
 	volatile long zoom_got;
+	volatile long zoom_poll_ms;
+	volatile bool pantilt_pos_mode, zoom_pos_mode; // true if the last request is a position move
+	struct ptz_position_request_s pantilt_pos_rsvd; // protected by mutex
+	volatile long zoom_pos_rsvd;
+	volatile long zoom_pos_cnt;
+	volatile bool position_wanted;
+	volatile bool position_got_valid;
+	volatile long pan_got, tilt_got;
+
+	// accessed only from the thread
+	visca_ip_socket_t sock;
+	uint8_t rx_buf[32];
+	size_t rx_len;
+	ptz_rtt rtt;
+	uint64_t next_send_ns; // held back after the camera returned an error
+	inflight_s inflight[2];
+	int n_inflight;
+	inquiry_s inquiry[3];
+	int n_inquiry;
+	int pan_sent, tilt_sent, zoom_sent;
+	unsigned int pantilt_pos_sent;
+	long zoom_pos_sent;
+	uint64_t zoom_poll_next_ns, position_poll_next_ns;
 
 	static void *thread_main(void *);
 	void thread_connect();
+	void thread_disconnect();
 	void thread_loop();
+	bool send_message(const uint8_t *p, size_t len);
+	inflight_s &send_command(cmd_kind_e kind, const uint8_t *p, size_t len);
+	void send_inquiry(inquiry_kind_e kind, const uint8_t *p, size_t len);
+	bool send_next(uint64_t ns);
+	void receive(uint64_t timeout_ns);
+	void handle_reply(const uint8_t *p, size_t len, uint64_t ns);
+	void expire(uint64_t ns);
+	void remove_inflight(int i, bool failed);
+	void remove_inquiry(int i);
+	bool is_inflight(cmd_kind_e kind) const;
+	bool is_inquired(inquiry_kind_e kind) const;
+	bool has_pending();
 
 public:
 	libvisca_thread();
@@ -30,11 +107,24 @@ public:
 	void set_pantilt_speed(int pan, int tilt) override {
 		os_atomic_set_long(&pan_rsvd, pan);
 		os_atomic_set_long(&tilt_rsvd, tilt);
+		os_atomic_set_bool(&pantilt_pos_mode, false);
+		os_event_signal(event);
+	}
+	void set_zoom_speed(int zoom) override {
+		os_atomic_set_long(&zoom_rsvd, zoom);
+		os_atomic_set_bool(&zoom_pos_mode, false);
+		os_event_signal(event);
 	}
-	void set_zoom_speed(int zoom) override { os_atomic_set_long(&zoom_rsvd, zoom); }
 	void recall_preset(int preset) override {
 		preset_rsvd = preset;
 		os_atomic_set_bool(&preset_changed, true);
+		os_event_signal(event);
 	}
 	int get_zoom() override { return os_atomic_load_long(&zoom_got); }
+
+	bool get_position(int &pan, int &tilt) override;
+	bool can_move_position() override { return true; }
+	void move_pantilt_absolute(int pan, int tilt, int speed_pan, int speed_tilt) override;
+	void move_pantilt_relative(int pan, int tilt, int speed_pan, int speed_tilt) override;
+	void move_zoom_absolute(int zoom) override;
 };
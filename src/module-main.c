@@ -14,6 +14,10 @@ OBS_MODULE_USE_DEFAULT_LOCALE(PLUGIN_NAME, "en-US")
 void register_face_tracker_filter(bool hide_filter, bool hide_source);
 void register_face_tracker_ptz(bool hide_ptz);
 void register_face_tracker_monitor(bool hide_monitor);
+#if defined(ENABLE_PTZ_SIMULATOR) && defined(WITH_PTZ_TCP)
+void register_ptz_simulator();
+#endif
+void face_detector_dlib_cnn_service_shutdown();
 
 bool obs_module_load(void)
 {
@@ -38,6 +42,9 @@ bool obs_module_load(void)
 	register_face_tracker_filter(!show_filter, !show_source);
 	register_face_tracker_ptz(!show_ptz);
 	register_face_tracker_monitor(!show_monitor);
+#if defined(ENABLE_PTZ_SIMULATOR) && defined(WITH_PTZ_TCP)
+	register_ptz_simulator();
+#endif
 
 #ifdef WITH_DOCK
 	config_set_default_bool(cfg, CONFIG_SECTION_NAME, "LoadDock", true);
@@ -53,4 +60,5 @@ void obs_module_unload()
 #ifdef WITH_DOCK
 	ft_docks_release();
 #endif // WITH_DOCK
+	face_detector_dlib_cnn_service_shutdown();
 }
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "helper.hpp"
+
+/*
+ * Constant-velocity Kalman filter for a face box.
+ * The state is the center and the size of the box (as f3) and their velocities per tick.
+ * Each axis is filtered independently.
+ */
+class motion_model
+{
+	float x[3], v[3];
+	float p00[3], p01[3], p11[3]; // covariance of (x, v) for each axis
+	int tick;
+	bool valid;
+
+	// Noise is proportional to the size of the face so that the filter works for any resolution.
+	static constexpr float meas_sigma = 0.04f; // relative to the size
+	static constexpr float accel_sigma = 0.01f; // relative to the size, per tick^2
+	static constexpr int max_horizon = 15; // ticks
+
+	void predict_to(int t)
+	{
+		const int dt = t - tick;
+		if (dt <= 0)
+			return;
+		const float q = sqf(accel_sigma * x[2]);
+		const float dt1 = (float)dt, dt2 = dt1 * dt1, dt3 = dt2 * dt1;
+		for (int i = 0; i < 3; i++) {
+			x[i] += v[i] * dt1;
+			p00[i] += 2.0f * p01[i] * dt1 + p11[i] * dt2 + q * dt3 / 3.0f;
+			p01[i] += p11[i] * dt1 + q * dt2 / 2.0f;
+			p11[i] += q * dt1;
+		}
+		tick = t;
+	}
+
+public:
+	motion_model() { valid = false; tick = 0; }
+
+	bool is_valid() const { return valid; }
+
+	void reset(const f3 &z, int t)
+	{
+		const float r = sqf(meas_sigma * z.v[2]);
+		for (int i = 0; i < 3; i++) {
+			x[i] = z.v[i];
+			v[i] = 0.0f;
+			p00[i] = r;
+			p01[i] = 0.0f;
+			p11[i] = r;
+		}
+		tick = t;
+		valid = true;
+	}
+
+	void update(const f3 &z, int t)
+	{
+		if (!valid || isnan(z)) {
+			if (!isnan(z))
+				reset(z, t);
+			return;
+		}
+
+		predict_to(t);
+		const float r = sqf(meas_sigma * z.v[2]);
+		for (int i = 0; i < 3; i++) {
+			const float s = p00[i] + r;
+			const float k0 = p00[i] / s;
+			const float k1 = p01[i] / s;
+			const float y = z.v[i] - x[i];
+			x[i] += k0 * y;
+			v[i] += k1 * y;
+			p11[i] -= k1 * p01[i];
+			p00[i] *= 1.0f - k0;
+			p01[i] *= 1.0f - k0;
+		}
+	}
+
+	f3 predict(int t) const
+	{
+		int dt = t - tick;
+		if (dt < 0) dt = 0;
+		if (dt > max_horizon) dt = max_horizon;
+		f3 u(x[0] + v[0] * dt, x[1] + v[1] * dt, x[2] + v[2] * dt);
+		if (u.v[2] < x[2] * 0.5f)
+			u.v[2] = x[2] * 0.5f;
+		return u;
+	}
+};
@@ -8,6 +8,8 @@
 #define debug(...) blog(LOG_INFO, __VA_ARGS__)
 
 #define SAME_CNT_TH 4
+#define INTERVAL_MIN_NS (16*1000*1000)
+#define INTERVAL_MAX_NS (60*1000*1000)
 
 obsptz_backend::obsptz_backend()
 {
@@ -51,6 +53,57 @@ proc_handler_t *obsptz_backend::get_ptz_ph()
 	return ptz_ph;
 }
 
+/*
+ * Calls ptz_move_continuous and holds the next command back by an interval
+ * derived from the round trip of the call, so that a fast PTZ plugin and camera are not slowed down
+ * and a slow one is not flooded.
+ */
+void obsptz_backend::call_move_continuous(calldata_t *cd)
+{
+	proc_handler_t *ph = get_ptz_ph();
+	if (!ph)
+		return;
+
+	uint64_t t0 = os_gettime_ns();
+	proc_handler_call(ph, "ptz_move_continuous", cd);
+	uint64_t t1 = os_gettime_ns();
+	rtt.update((int64_t)(t1 - t0));
+
+	int64_t interval = rtt.timeout_ns();
+	if (interval < INTERVAL_MIN_NS) interval = INTERVAL_MIN_NS;
+	if (interval > INTERVAL_MAX_NS) interval = INTERVAL_MAX_NS;
+	available_ns = std::max(available_ns, t1) + interval;
+}
+
+void obsptz_backend::set_speed(int pan, int tilt, int zoom)
+{
+	if (pan==prev_pan && tilt==prev_tilt && zoom==prev_zoom) {
+		if (same_speed_cnt > SAME_CNT_TH)
+			return;
+		same_speed_cnt ++;
+	}
+	else {
+		same_speed_cnt = 0;
+	}
+
+	if (!get_ptz_ph()) {
+		// compatibility
+		set_pantilt_speed(pan, tilt);
+		return;
+	}
+
+	CALLDATA_FIXED_DECL(cd, 128);
+	calldata_set_int(&cd, "device_id", device_id);
+	calldata_set_float(&cd, "pan", pan / 24.0f);
+	calldata_set_float(&cd, "tilt", -tilt / 20.0f);
+	calldata_set_float(&cd, "zoom", -zoom / 7.0f);
+	call_move_continuous(&cd);
+
+	prev_pan = pan;
+	prev_tilt = tilt;
+	prev_zoom = zoom;
+}
+
 void obsptz_backend::set_pantilt_speed(int pan, int tilt)
 {
 	if (pan==prev_pan && tilt==prev_tilt) {
@@ -66,16 +119,15 @@ void obsptz_backend::set_pantilt_speed(int pan, int tilt)
 	calldata_set_int(&cd, "device_id", device_id);
 	calldata_set_float(&cd, "pan", pan / 24.0f);
 	calldata_set_float(&cd, "tilt", -tilt / 20.0f);
-	proc_handler_t *ph = get_ptz_ph();
-	if (ph)
-		proc_handler_call(ph, "ptz_move_continuous", &cd);
+	if (get_ptz_ph())
+		call_move_continuous(&cd);
 	else {
 		// compatibility
-		ph = obs_get_proc_handler();
+		proc_handler_t *ph = obs_get_proc_handler();
 		proc_handler_call(ph, "ptz_pantilt", &cd);
+		uint64_t ns = os_gettime_ns();
+		available_ns = std::max(available_ns, ns) + INTERVAL_MAX_NS;
 	}
-	uint64_t ns = os_gettime_ns();
-	available_ns = std::max(available_ns, ns) + (60*1000*1000);
 	prev_pan = pan;
 	prev_tilt = tilt;
 }
@@ -91,17 +143,14 @@ void obsptz_backend::set_zoom_speed(int zoom)
 		same_zoom_cnt = 0;
 	}
 
-	proc_handler_t *ph = get_ptz_ph();
-	if (!ph)
+	if (!get_ptz_ph())
 		return;
 
 	CALLDATA_FIXED_DECL(cd, 128);
 	calldata_set_int(&cd, "device_id", device_id);
 	calldata_set_float(&cd, "zoom", -zoom / 7.0f);
-	proc_handler_call(ph, "ptz_move_continuous", &cd);
+	call_move_continuous(&cd);
 
-	uint64_t ns = os_gettime_ns();
-	available_ns = std::max(available_ns, ns) + (60*1000*1000);
 	prev_zoom = zoom;
 }
 
@@ -1,5 +1,6 @@
 #pragma once
 #include "ptz-backend.hpp"
+#include "ptz-rtt.hpp"
 
 class obsptz_backend : public ptz_backend
 {
@@ -12,6 +13,9 @@ class obsptz_backend : public ptz_backend
 	int prev_zoom = 0;
 	int same_pantilt_cnt = 0;
 	int same_zoom_cnt = 0;
+	int same_speed_cnt = 0;
+	ptz_rtt rtt; // round trip of the proc handler call
+	void call_move_continuous(calldata_t *cd);
 public:
 	obsptz_backend();
 	~obsptz_backend() override;
@@ -21,6 +25,7 @@ public:
 	void tick() override;
 	void set_pantilt_speed(int pan, int tilt) override;
 	void set_zoom_speed(int zoom) override;
+	void set_speed(int pan, int tilt, int zoom) override;
 	void recall_preset(int preset) override;
 	int get_zoom() override;
 };
@@ -2,6 +2,19 @@
 
 #include <util/threading.h>
 
+/*
+ * A pan-tilt move to a position requested through the backend.
+ * The counter is incremented for each request so that the sending thread can tell a new request
+ * even if the same position is requested again.
+ */
+struct ptz_position_request_s
+{
+	int pan, tilt;
+	int speed_pan, speed_tilt;
+	bool relative;
+	unsigned int cnt;
+};
+
 class ptz_backend
 {
 	volatile long ref;
@@ -19,6 +32,20 @@ public:
 	virtual void tick() {}
 	virtual void set_pantilt_speed(int pan, int tilt) = 0;
 	virtual void set_zoom_speed(int zoom) = 0;
+	// Sends pan, tilt, and zoom speed at once if the backend can, otherwise separately.
+	virtual void set_speed(int pan, int tilt, int zoom) {
+		set_pantilt_speed(pan, tilt);
+		set_zoom_speed(zoom);
+	}
 	virtual void recall_preset(int preset) = 0;
 	virtual int get_zoom() = 0;
+
+	/* Position feedback and position moves
+	 * A backend that cannot tell the pan-tilt position returns false from get_position.
+	 * The position moves are available only if can_move_position returns true. */
+	virtual bool get_position(int &, int &) { return false; }
+	virtual bool can_move_position() { return false; }
+	virtual void move_pantilt_absolute(int, int, int, int) {}
+	virtual void move_pantilt_relative(int, int, int, int) {}
+	virtual void move_zoom_absolute(int) {}
 };
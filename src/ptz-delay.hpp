@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cmath>
+
+/*
+ * Estimates the dead time from a command to the PTZ camera until the motion appears in the error,
+ * and the gain from the commanded motion to the observed motion, for one axis.
+ *
+ * Every tick, push_command() records the commanded motion in the unit of the error
+ * and observe() takes the change of the error in the tick.
+ * The change is correlated with the commands issued 1 ... n_lag ticks before;
+ * the lag with the best correlation is the dead time.
+ * A lag of 0 means the command appears in the error at the next tick, which the controller assumes without compensation.
+ * The sums are exponentially weighted so that the estimate follows changes of the camera or the video pipeline.
+ */
+class ptz_delay_estimator
+{
+public:
+	static constexpr int n_lag = 24;
+
+private:
+	float hist[n_lag]; // commanded motion, hist[0] is the latest
+	float sxy[n_lag], sxx[n_lag], syy;
+	int n_observed;
+
+	static constexpr float decay = 0.995f; // about 200 ticks
+	static constexpr float corr_min = 0.3f;
+	static constexpr int n_observed_min = 60;
+
+public:
+	ptz_delay_estimator() { reset(); }
+
+	void reset()
+	{
+		for (int k = 0; k < n_lag; k++)
+			hist[k] = sxy[k] = sxx[k] = 0.0f;
+		syy = 0.0f;
+		n_observed = 0;
+	}
+
+	void push_command(float m)
+	{
+		for (int k = n_lag - 1; k > 0; k--)
+			hist[k] = hist[k - 1];
+		hist[0] = m;
+	}
+
+	// `de` is the change of the error since the previous tick.
+	void observe(float de)
+	{
+		const float y = -de; // a positive command reduces the error
+		for (int k = 0; k < n_lag; k++) {
+			sxy[k] = sxy[k] * decay + hist[k] * y;
+			sxx[k] = sxx[k] * decay + hist[k] * hist[k];
+		}
+		syy = syy * decay + y * y;
+		n_observed++;
+	}
+
+	// Returns the dead time in ticks, or -1 if the commands do not explain the observation well.
+	int get_delay() const
+	{
+		if (n_observed < n_observed_min)
+			return -1;
+		int best = -1;
+		float r_best = corr_min;
+		for (int k = 0; k < n_lag; k++) {
+			if (sxx[k] <= 0.0f || syy <= 0.0f || sxy[k] <= 0.0f)
+				continue;
+			float r = sxy[k] / sqrtf(sxx[k] * syy);
+			if (r > r_best) {
+				r_best = r;
+				best = k;
+			}
+		}
+		return best;
+	}
+
+	// Ratio of the observed motion to the commanded motion at the lag.
+	float get_gain(int lag) const
+	{
+		if (lag < 0 || lag >= n_lag || sxx[lag] <= 0.0f)
+			return 1.0f;
+		float g = sxy[lag] / sxx[lag];
+		return g < 0.2f ? 0.2f : g > 5.0f ? 5.0f : g;
+	}
+
+	// Motion that has been commanded but has not appeared in the error yet.
+	float get_pending(int lag) const
+	{
+		float sum = 0.0f;
+		for (int k = 0; k < lag && k < n_lag; k++)
+			sum += hist[k];
+		return sum;
+	}
+};
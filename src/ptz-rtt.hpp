@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+
+/*
+ * Round-trip time estimator for the commands sent to a camera.
+ * The smoothing follows the retransmission timer of TCP (RFC 6298).
+ * The interval between commands is derived from the estimate
+ * so that a slow camera is not flooded and a fast camera does not wait for nothing.
+ */
+class ptz_rtt
+{
+	int64_t srtt_ns, rttvar_ns;
+	bool valid;
+
+	static constexpr int64_t initial_ns = 48000000; // used until the first reply arrives
+	static constexpr int64_t timeout_min_ns = 20000000;
+	static constexpr int64_t timeout_max_ns = 1000000000;
+
+public:
+	ptz_rtt() { reset(); }
+
+	void reset()
+	{
+		srtt_ns = 0;
+		rttvar_ns = 0;
+		valid = false;
+	}
+
+	void update(int64_t rtt_ns)
+	{
+		if (rtt_ns < 0)
+			return;
+		if (!valid) {
+			srtt_ns = rtt_ns;
+			rttvar_ns = rtt_ns / 2;
+			valid = true;
+			return;
+		}
+		int64_t err = rtt_ns - srtt_ns;
+		rttvar_ns += ((err < 0 ? -err : err) - rttvar_ns) / 4;
+		srtt_ns += err / 8;
+	}
+
+	bool is_valid() const { return valid; }
+	int64_t get_srtt_ns() const { return valid ? srtt_ns : initial_ns; }
+
+	// Interval to keep after a completed command before sending the next one.
+	int64_t pacing_ns() const { return valid ? srtt_ns / 2 : initial_ns; }
+
+	// Time to wait for a reply before the command is considered lost, also used to back off after an error.
+	int64_t timeout_ns() const
+	{
+		if (!valid)
+			return initial_ns * 4;
+		int64_t t = srtt_ns + 4 * rttvar_ns;
+		return t < timeout_min_ns ? timeout_min_ns : t > timeout_max_ns ? timeout_max_ns : t;
+	}
+};
@@ -0,0 +1,131 @@
+#include <obs-module.h>
+#include <util/platform.h>
+#include "plugin-macros.generated.h"
+#include "ptz-shared-backend.hpp"
+
+#define debug(...) blog(LOG_INFO, __VA_ARGS__)
+
+// The other user can take the control after the user controlling the camera did not move it for this time.
+#define OWNER_HOLD_NS 1000000000ULL
+
+ptz_backend_registry::ptz_backend_registry()
+{
+	pthread_mutex_init(&mutex, NULL);
+}
+
+ptz_backend_registry::~ptz_backend_registry()
+{
+	pthread_mutex_destroy(&mutex);
+}
+
+ptz_backend_registry &ptz_backend_registry::get()
+{
+	static ptz_backend_registry instance;
+	return instance;
+}
+
+ptz_backend_registry::entry_s *ptz_backend_registry::acquire(const std::string &key, class ptz_backend *(*create)())
+{
+	pthread_mutex_lock(&mutex);
+	entry_s *entry;
+	auto it = entries.find(key);
+	if (it != entries.end()) {
+		entry = it->second;
+		debug("ptz_backend_registry: sharing '%s' with %d user(s)", key.c_str(), entry->n_users);
+	}
+	else {
+		entry = new entry_s;
+		entry->key = key;
+		entry->dev = create();
+		entry->n_users = 0;
+		entry->owner = NULL;
+		entry->owner_moved_ns = 0;
+		entry->config_user = NULL;
+		entries[key] = entry;
+	}
+	entry->n_users++;
+	pthread_mutex_unlock(&mutex);
+	return entry;
+}
+
+void ptz_backend_registry::release(entry_s *entry, const void *user)
+{
+	pthread_mutex_lock(&mutex);
+	if (entry->owner == user)
+		entry->owner = NULL;
+	if (entry->config_user == user)
+		entry->config_user = NULL;
+	if (--entry->n_users > 0) {
+		pthread_mutex_unlock(&mutex);
+		return;
+	}
+	entries.erase(entry->key);
+	pthread_mutex_unlock(&mutex);
+
+	entry->dev->release();
+	delete entry;
+}
+
+bool ptz_backend_registry::arbitrate(entry_s *entry, const void *user, bool move)
+{
+	bool ret;
+	pthread_mutex_lock(&mutex);
+	if (entry->owner == user) {
+		ret = true;
+	}
+	else if (!move) {
+		ret = false;
+	}
+	else if (!entry->owner || entry->owner_moved_ns + OWNER_HOLD_NS < os_gettime_ns()) {
+		if (entry->n_users > 1)
+			debug("ptz_backend_registry: '%s' is controlled by %p", entry->key.c_str(), user);
+		entry->owner = user;
+		ret = true;
+	}
+	else {
+		ret = false;
+	}
+	if (ret && move)
+		entry->owner_moved_ns = os_gettime_ns();
+	pthread_mutex_unlock(&mutex);
+	return ret;
+}
+
+bool ptz_backend_registry::claim_config(entry_s *entry, const void *user)
+{
+	pthread_mutex_lock(&mutex);
+	if (!entry->config_user)
+		entry->config_user = user;
+	bool ret = entry->config_user == user;
+	pthread_mutex_unlock(&mutex);
+	return ret;
+}
+
+ptz_shared_backend::ptz_shared_backend(const char *type_, class ptz_backend *(*create_)())
+{
+	type = type_;
+	create = create_;
+}
+
+ptz_shared_backend::~ptz_shared_backend()
+{
+	if (entry)
+		ptz_backend_registry::get().release(entry, this);
+}
+
+void ptz_shared_backend::set_config(struct obs_data *data)
+{
+	const char *address = obs_data_get_string(data, "address");
+	const std::string key = type + "://" + (address ? address : "") + ":" + std::to_string(obs_data_get_int(data, "port"));
+
+	if (!entry || entry->key != key) {
+		ptz_backend_registry::entry_s *entry_new = ptz_backend_registry::get().acquire(key, create);
+		if (entry)
+			ptz_backend_registry::get().release(entry, this);
+		entry = entry_new;
+	}
+
+	// Otherwise the last user updating its settings would override the others.
+	if (ptz_backend_registry::get().claim_config(entry, this))
+		entry->dev->set_config(data);
+}
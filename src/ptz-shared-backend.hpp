@@ -0,0 +1,103 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <util/threading.h>
+#include "ptz-backend.hpp"
+
+/*
+ * Process-wide registry of the backends keyed by the type, address, and port of the camera.
+ * Many VISCA cameras accept only one TCP connection,
+ * so the filters addressing the same camera share one backend through ptz_shared_backend.
+ *
+ * Only one user controls the camera at a time.
+ * A user takes the control by a move if the camera is not controlled or the user controlling it has not moved it for a while.
+ * A stop from a user that does not control the camera is discarded so that it won't stop the move of the other user.
+ *
+ * The settings of the connection, such as the zoom polling interval, are taken only from the user that configured the backend first.
+ * When that user leaves, the next user calling set_config takes it over.
+ */
+class ptz_backend_registry
+{
+public:
+	struct entry_s
+	{
+		std::string key;
+		class ptz_backend *dev;
+		int n_users;
+		const void *owner;
+		uint64_t owner_moved_ns;
+		const void *config_user;
+	};
+
+	static ptz_backend_registry &get();
+
+	entry_s *acquire(const std::string &key, class ptz_backend *(*create)());
+	void release(entry_s *entry, const void *user);
+
+	// Returns true if the command from the user should be sent to the camera.
+	bool arbitrate(entry_s *entry, const void *user, bool move);
+
+	// Returns true if the settings from the user should be applied to the backend.
+	bool claim_config(entry_s *entry, const void *user);
+
+private:
+	pthread_mutex_t mutex;
+	std::map<std::string, entry_s *> entries;
+
+	ptz_backend_registry();
+	~ptz_backend_registry();
+};
+
+class ptz_shared_backend : public ptz_backend
+{
+	std::string type;
+	class ptz_backend *(*create)();
+	ptz_backend_registry::entry_s *entry = NULL;
+
+	bool arbitrate(bool move) { return entry && ptz_backend_registry::get().arbitrate(entry, this, move); }
+
+public:
+	ptz_shared_backend(const char *type, class ptz_backend *(*create)());
+	~ptz_shared_backend() override;
+
+	void set_config(struct obs_data *data) override; // and switch the shared backend if the address is changed
+
+	bool can_send() override { return entry && entry->dev->can_send(); }
+	void tick() override {
+		if (entry)
+			entry->dev->tick();
+	}
+	void set_pantilt_speed(int pan, int tilt) override {
+		if (arbitrate(pan || tilt))
+			entry->dev->set_pantilt_speed(pan, tilt);
+	}
+	void set_zoom_speed(int zoom) override {
+		if (arbitrate(zoom != 0))
+			entry->dev->set_zoom_speed(zoom);
+	}
+	void set_speed(int pan, int tilt, int zoom) override {
+		if (arbitrate(pan || tilt || zoom))
+			entry->dev->set_speed(pan, tilt, zoom);
+	}
+	void recall_preset(int preset) override {
+		if (arbitrate(true))
+			entry->dev->recall_preset(preset);
+	}
+	int get_zoom() override { return entry ? entry->dev->get_zoom() : 0; }
+
+	bool get_position(int &pan, int &tilt) override { return entry && entry->dev->get_position(pan, tilt); }
+	bool can_move_position() override { return entry && entry->dev->can_move_position(); }
+	void move_pantilt_absolute(int pan, int tilt, int speed_pan, int speed_tilt) override {
+		if (arbitrate(true))
+			entry->dev->move_pantilt_absolute(pan, tilt, speed_pan, speed_tilt);
+	}
+	void move_pantilt_relative(int pan, int tilt, int speed_pan, int speed_tilt) override {
+		if (arbitrate(pan || tilt))
+			entry->dev->move_pantilt_relative(pan, tilt, speed_pan, speed_tilt);
+	}
+	void move_zoom_absolute(int zoom) override {
+		if (arbitrate(true))
+			entry->dev->move_zoom_absolute(zoom);
+	}
+};
@@ -0,0 +1,209 @@
+#pragma once
+
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <deque>
+
+/*
+ * Model of the motion of a PTZ camera for the simulator.
+ * The pan and tilt are in the position steps of VISCA and the zoom is in the raw value from 0 to 16384.
+ *
+ * A command takes effect after the latency.
+ * The speed of the command is quantized to the VISCA steps and mapped to the speed of the motion,
+ * which is followed within the limit of the acceleration.
+ * A move to a position decelerates so that it stops at the position.
+ */
+class ptz_sim_camera
+{
+public:
+	struct params_s
+	{
+		float pan_speed_max; // steps per second at the speed 0x18
+		float tilt_speed_max; // steps per second at the speed 0x14
+		float accel; // steps per second squared
+		float zoom_speed_max; // raw value per second at the fastest speed
+		float latency; // second
+		int pan_min, pan_max;
+		int tilt_min, tilt_max;
+	};
+
+	static constexpr int pan_speed_steps = 0x18;
+	static constexpr int tilt_speed_steps = 0x14;
+	static constexpr int zoom_speed_steps = 8; // the speed 0 to 7 of VISCA is given as 1 to 8
+	static constexpr int zoom_raw_max = 16384;
+
+private:
+	enum cmd_kind_e
+	{
+		cmd_pantilt_speed,
+		cmd_pantilt_absolute,
+		cmd_pantilt_relative,
+		cmd_zoom_speed,
+		cmd_zoom_absolute,
+	};
+
+	struct cmd_s
+	{
+		double t; // when the command takes effect
+		cmd_kind_e kind;
+		int a, b, c, d;
+	};
+
+	params_s p;
+	std::deque<cmd_s> queue;
+	double t = 0.0;
+
+	// current command
+	bool pantilt_pos_mode = false;
+	float pan_speed_cmd = 0.0f, tilt_speed_cmd = 0.0f; // signed speed or the speed limit of the position move
+	float pan_target = 0.0f, tilt_target = 0.0f;
+	bool zoom_pos_mode = false;
+	float zoom_speed_cmd = 0.0f;
+	float zoom_target = 0.0f;
+
+public:
+	float pan = 0.0f, tilt = 0.0f, zoom = 0.0f;
+	float pan_vel = 0.0f, tilt_vel = 0.0f;
+
+	ptz_sim_camera()
+	{
+		p.pan_speed_max = 1200.0f;
+		p.tilt_speed_max = 900.0f;
+		p.accel = 3000.0f;
+		p.zoom_speed_max = 8000.0f;
+		p.latency = 0.1f;
+		p.pan_min = -2400;
+		p.pan_max = 2400;
+		p.tilt_min = -1200;
+		p.tilt_max = 1200;
+	}
+
+	void set_params(const params_s &p_) { p = p_; }
+
+	// The speed grows quadratically with the VISCA step so that the slow steps are fine.
+	static float quantized_speed(int v, int steps, float max)
+	{
+		int a = std::abs(v);
+		if (a == 0)
+			return 0.0f;
+		if (a > steps)
+			a = steps;
+		float x = (float)a / steps;
+		return (v < 0 ? -max : max) * x * x;
+	}
+
+	void command_pantilt_speed(int pan_v, int tilt_v) { push(cmd_pantilt_speed, pan_v, tilt_v, 0, 0); }
+	void command_pantilt_absolute(int pan_, int tilt_, int speed_pan, int speed_tilt) { push(cmd_pantilt_absolute, pan_, tilt_, speed_pan, speed_tilt); }
+	void command_pantilt_relative(int pan_, int tilt_, int speed_pan, int speed_tilt) { push(cmd_pantilt_relative, pan_, tilt_, speed_pan, speed_tilt); }
+	void command_zoom_speed(int zoom_v) { push(cmd_zoom_speed, zoom_v, 0, 0, 0); }
+	void command_zoom_absolute(int zoom_) { push(cmd_zoom_absolute, zoom_, 0, 0, 0); }
+
+	void tick(float dt)
+	{
+		t += dt;
+		while (queue.size() && queue.front().t <= t) {
+			apply(queue.front());
+			queue.pop_front();
+		}
+
+		pan_vel = next_velocity(pan_vel, pan, pan_target, pan_speed_cmd, dt);
+		tilt_vel = next_velocity(tilt_vel, tilt, tilt_target, tilt_speed_cmd, dt);
+		pan = clamp_axis(pan + pan_vel * dt, p.pan_min, p.pan_max, pan_vel);
+		tilt = clamp_axis(tilt + tilt_vel * dt, p.tilt_min, p.tilt_max, tilt_vel);
+		if (pantilt_pos_mode) {
+			snap(pan, pan_vel, pan_target, dt);
+			snap(tilt, tilt_vel, tilt_target, dt);
+		}
+
+		if (zoom_pos_mode) {
+			float dz = zoom_target - zoom;
+			float step = std::abs(zoom_speed_cmd) * dt;
+			zoom += std::abs(dz) <= step ? dz : dz > 0.0f ? step : -step;
+		}
+		else {
+			zoom += zoom_speed_cmd * dt;
+		}
+		float v = 0.0f;
+		zoom = clamp_axis(zoom, 0, zoom_raw_max, v);
+	}
+
+private:
+	void push(cmd_kind_e kind, int a, int b, int c, int d)
+	{
+		cmd_s cmd = {t + p.latency, kind, a, b, c, d};
+		queue.push_back(cmd);
+	}
+
+	void apply(const cmd_s &cmd)
+	{
+		switch (cmd.kind) {
+			case cmd_pantilt_speed:
+				pantilt_pos_mode = false;
+				pan_speed_cmd = quantized_speed(cmd.a, pan_speed_steps, p.pan_speed_max);
+				tilt_speed_cmd = quantized_speed(cmd.b, tilt_speed_steps, p.tilt_speed_max);
+				break;
+			case cmd_pantilt_absolute:
+			case cmd_pantilt_relative:
+				pantilt_pos_mode = true;
+				pan_target = (float)cmd.a;
+				tilt_target = (float)cmd.b;
+				if (cmd.kind == cmd_pantilt_relative) {
+					pan_target += pan;
+					tilt_target += tilt;
+				}
+				pan_speed_cmd = quantized_speed(cmd.c, pan_speed_steps, p.pan_speed_max);
+				tilt_speed_cmd = quantized_speed(cmd.d, tilt_speed_steps, p.tilt_speed_max);
+				break;
+			case cmd_zoom_speed:
+				zoom_pos_mode = false;
+				zoom_speed_cmd = quantized_speed(cmd.a, zoom_speed_steps, p.zoom_speed_max);
+				break;
+			case cmd_zoom_absolute:
+				zoom_pos_mode = true;
+				zoom_target = (float)cmd.a;
+				zoom_speed_cmd = p.zoom_speed_max;
+				break;
+		}
+	}
+
+	float next_velocity(float vel, float x, float target, float speed, float dt) const
+	{
+		float v_des = speed;
+		if (pantilt_pos_mode) {
+			float e = target - x;
+			// The fastest speed that can stop at the target.
+			float v_stop = sqrtf(2.0f * p.accel * std::abs(e));
+			v_des = std::min(std::abs(speed), v_stop) * (e < 0.0f ? -1.0f : 1.0f);
+		}
+		float dv = v_des - vel;
+		float dv_max = p.accel * dt;
+		if (dv > dv_max)
+			dv = dv_max;
+		else if (dv < -dv_max)
+			dv = -dv_max;
+		return vel + dv;
+	}
+
+	// Stops at the target instead of oscillating around it by the discrete time.
+	void snap(float &x, float &vel, float target, float dt) const
+	{
+		if (std::abs(target - x) < 0.5f && std::abs(vel) <= p.accel * dt) {
+			x = target;
+			vel = 0.0f;
+		}
+	}
+
+	static float clamp_axis(float x, int x_min, int x_max, float &vel)
+	{
+		if (x < x_min) {
+			vel = 0.0f;
+			return (float)x_min;
+		}
+		if (x > x_max) {
+			vel = 0.0f;
+			return (float)x_max;
+		}
+		return x;
+	}
+};
@@ -0,0 +1,388 @@
+#include <obs-module.h>
+#include <util/platform.h>
+#include <graphics/graphics.h>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+#include "plugin-macros.generated.h"
+#include "visca-sim-server.hpp"
+
+/*
+ * PTZ simulator
+ * The source renders the view of a simulated PTZ camera looking at a still image
+ * and the camera is controlled by VISCA over IP on the loopback address.
+ * Add Face Tracker PTZ to this source with `VISCA over IP (UDP)` to 127.0.0.1 to close the loop.
+ *
+ * The step button moves the subject on the image and the response of the camera is measured.
+ * The settling time and the overshoot are written to the log and returned by the procedure `get_metrics`.
+ */
+
+#define ZOOM_RATIO_MAX 20.0f // same as raw2zoomfactor of Face Tracker PTZ
+
+enum step_axis_e
+{
+	step_axis_none = -1,
+	step_axis_pan = 0,
+	step_axis_tilt = 1,
+};
+
+struct ptz_simulator
+{
+	obs_source_t *context;
+	visca_sim_server *server;
+	int port;
+
+	char *image_path;
+	uint8_t *image_data;
+	enum gs_color_format image_format;
+	uint32_t image_cx, image_cy;
+
+	uint32_t width, height;
+	float image_pan_steps; // pan steps across the image
+	float fov_pan_steps; // pan steps across the view at the wide end
+	uint8_t *frame_buf;
+	std::vector<int> *sx_buf;
+
+	// The fields below are written from the buttons and read by the tick, protected by server->mutex.
+	float subject[2]; // location of the subject in pan and tilt steps
+
+	// step response
+	float step_size;
+	float settle_band; // ratio to the step
+	float step_duration;
+	int step_axis;
+	float step_target;
+	float step_t;
+	float step_overshoot;
+	float step_last_outside_t;
+	float settling_time; // negative if not settled
+	float overshoot; // ratio to the step
+	bool metrics_valid;
+};
+
+static const char *ptzsim_get_name(void *)
+{
+	return obs_module_text("Face Tracker PTZ Simulator");
+}
+
+static void ptzsim_update(void *data, obs_data_t *settings);
+static void cb_get_metrics(void *data, calldata_t *cd);
+
+static void *ptzsim_create(obs_data_t *settings, obs_source_t *context)
+{
+	auto *s = (struct ptz_simulator*)bzalloc(sizeof(struct ptz_simulator));
+	s->context = context;
+	s->server = new visca_sim_server();
+	s->sx_buf = new std::vector<int>();
+	s->step_axis = step_axis_none;
+
+	obs_source_update(context, settings);
+
+	proc_handler_t *ph = obs_source_get_proc_handler(context);
+	proc_handler_add(ph, "void get_metrics()", cb_get_metrics, s);
+
+	return s;
+}
+
+static void ptzsim_destroy(void *data)
+{
+	auto *s = (struct ptz_simulator*)data;
+
+	delete s->server;
+	delete s->sx_buf;
+	bfree(s->image_path);
+	bfree(s->image_data);
+	bfree(s->frame_buf);
+	bfree(s);
+}
+
+static void load_image(struct ptz_simulator *s, const char *path)
+{
+	bfree(s->image_data);
+	s->image_data = NULL;
+	if (!path || !*path)
+		return;
+
+	s->image_data = gs_create_texture_file_data(path, &s->image_format, &s->image_cx, &s->image_cy);
+	if (!s->image_data) {
+		blog(LOG_ERROR, "[%s] failed to load image '%s'", obs_source_get_name(s->context), path);
+		return;
+	}
+	if (s->image_format != GS_RGBA && s->image_format != GS_BGRA) {
+		blog(LOG_ERROR, "[%s] unsupported image format %d", obs_source_get_name(s->context), (int)s->image_format);
+		bfree(s->image_data);
+		s->image_data = NULL;
+	}
+}
+
+static void ptzsim_update(void *data, obs_data_t *settings)
+{
+	auto *s = (struct ptz_simulator*)data;
+
+	const char *image_path = obs_data_get_string(settings, "image");
+	if (!s->image_path || strcmp(image_path, s->image_path)) {
+		bfree(s->image_path);
+		s->image_path = bstrdup(image_path);
+		load_image(s, image_path);
+	}
+
+	uint32_t width = (uint32_t)obs_data_get_int(settings, "width");
+	uint32_t height = (uint32_t)obs_data_get_int(settings, "height");
+	if (width != s->width || height != s->height || !s->frame_buf) {
+		s->width = width;
+		s->height = height;
+		bfree(s->frame_buf);
+		s->frame_buf = (uint8_t *)bzalloc(width * height * 4);
+	}
+
+	s->image_pan_steps = (float)obs_data_get_int(settings, "image_pan_steps");
+	s->fov_pan_steps = (float)obs_data_get_int(settings, "fov_pan_steps");
+
+	ptz_sim_camera::params_s p;
+	p.pan_speed_max = (float)obs_data_get_double(settings, "pan_speed_max");
+	p.tilt_speed_max = (float)obs_data_get_double(settings, "tilt_speed_max");
+	p.accel = (float)obs_data_get_double(settings, "accel");
+	p.zoom_speed_max = (float)obs_data_get_double(settings, "zoom_speed_max");
+	p.latency = (float)(obs_data_get_double(settings, "latency_ms") * 1e-3);
+	p.pan_max = (int)(s->image_pan_steps * 0.5f);
+	p.pan_min = -p.pan_max;
+	p.tilt_max = s->image_cx ? (int)(s->image_pan_steps * s->image_cy / s->image_cx * 0.5f) : p.pan_max;
+	p.tilt_min = -p.tilt_max;
+	pthread_mutex_lock(&s->server->mutex);
+	s->server->camera.set_params(p);
+	s->step_size = (float)obs_data_get_int(settings, "step_size");
+	s->settle_band = (float)(obs_data_get_double(settings, "settle_band") * 1e-2);
+	s->step_duration = (float)obs_data_get_double(settings, "step_duration");
+	pthread_mutex_unlock(&s->server->mutex);
+
+	int port = (int)obs_data_get_int(settings, "port");
+	if (port != s->port) {
+		s->port = port;
+		s->server->start(port);
+	}
+}
+
+static void step_start(struct ptz_simulator *s, int axis)
+{
+	pthread_mutex_lock(&s->server->mutex);
+	const float x = axis == step_axis_pan ? s->server->camera.pan : s->server->camera.tilt;
+
+	// The camera has to move as much as the subject to keep it at the same location on the view.
+	s->subject[axis] += s->step_size;
+	s->step_axis = axis;
+	s->step_target = x + s->step_size;
+	s->step_t = 0.0f;
+	s->step_overshoot = 0.0f;
+	s->step_last_outside_t = 0.0f;
+	pthread_mutex_unlock(&s->server->mutex);
+}
+
+// Called with server->mutex locked.
+static void step_tick(struct ptz_simulator *s, float x, float second)
+{
+	const float size = std::abs(s->step_size);
+	const float sign = s->step_size < 0.0f ? -1.0f : 1.0f;
+
+	s->step_t += second;
+	const float e = (x - s->step_target) * sign;
+	if (e > s->step_overshoot)
+		s->step_overshoot = e;
+	if (std::abs(e) > std::max(size * s->settle_band, 1.0f))
+		s->step_last_outside_t = s->step_t;
+
+	if (s->step_t < s->step_duration)
+		return;
+
+	const char *axis_name = s->step_axis == step_axis_pan ? "pan" : "tilt";
+	s->overshoot = size > 0.0f ? s->step_overshoot / size : 0.0f;
+	if (s->step_last_outside_t < s->step_t - second) {
+		s->settling_time = s->step_last_outside_t;
+		blog(LOG_INFO, "[%s] step response (%s): settling time %.3f s, overshoot %.1f %%",
+				obs_source_get_name(s->context), axis_name, s->settling_time, s->overshoot * 100.0f);
+	}
+	else {
+		s->settling_time = -1.0f;
+		blog(LOG_INFO, "[%s] step response (%s): not settled in %.1f s, overshoot %.1f %%",
+				obs_source_get_name(s->context), axis_name, s->step_duration, s->overshoot * 100.0f);
+	}
+	s->metrics_valid = true;
+	s->step_axis = step_axis_none;
+}
+
+// `pan` and `tilt` are relative to the subject.
+static void render_view(struct ptz_simulator *s, float pan, float tilt, float zoom)
+{
+	const uint32_t w = s->width, h = s->height;
+	const float px_per_step = s->image_cx / s->image_pan_steps;
+	const float zf = expf(zoom * (logf(ZOOM_RATIO_MAX) / ptz_sim_camera::zoom_raw_max));
+	const float view_w = s->fov_pan_steps / zf * px_per_step;
+	const float cx = s->image_cx * 0.5f + pan * px_per_step;
+	const float cy = s->image_cy * 0.5f - tilt * px_per_step; // tilt position increases upward
+	const float scale = view_w / w;
+
+	std::vector<int> &sx = *s->sx_buf;
+	sx.resize(w);
+	for (uint32_t x = 0; x < w; x++) {
+		sx[x] = (int)floorf(cx + ((float)x - w * 0.5f) * scale);
+		if (sx[x] < 0 || sx[x] >= (int)s->image_cx)
+			sx[x] = -1;
+	}
+
+	const uint32_t *src = (const uint32_t *)s->image_data;
+	for (uint32_t y = 0; y < h; y++) {
+		uint32_t *dst = (uint32_t *)(s->frame_buf + y * w * 4);
+		const int sy = (int)floorf(cy + ((float)y - h * 0.5f) * scale);
+		if (sy < 0 || sy >= (int)s->image_cy) {
+			memset(dst, 0, w * 4);
+			continue;
+		}
+		const uint32_t *src_line = src + sy * s->image_cx;
+		for (uint32_t x = 0; x < w; x++)
+			dst[x] = sx[x] >= 0 ? src_line[sx[x]] : 0;
+	}
+}
+
+static void ptzsim_tick(void *data, float second)
+{
+	auto *s = (struct ptz_simulator*)data;
+
+	pthread_mutex_lock(&s->server->mutex);
+	s->server->camera.tick(second);
+	const float pan = s->server->camera.pan;
+	const float tilt = s->server->camera.tilt;
+	const float zoom = s->server->camera.zoom;
+	const float subject_pan = s->subject[0];
+	const float subject_tilt = s->subject[1];
+	if (s->step_axis != step_axis_none)
+		step_tick(s, s->step_axis == step_axis_pan ? pan : tilt, second);
+	pthread_mutex_unlock(&s->server->mutex);
+
+	if (!s->image_data || !s->frame_buf || !s->width || !s->height || s->image_pan_steps <= 0.0f)
+		return;
+
+	render_view(s, pan - subject_pan, tilt - subject_tilt, zoom);
+
+	struct obs_source_frame frame = {};
+	frame.data[0] = s->frame_buf;
+	frame.linesize[0] = s->width * 4;
+	frame.width = s->width;
+	frame.height = s->height;
+	frame.format = s->image_format == GS_RGBA ? VIDEO_FORMAT_RGBA : VIDEO_FORMAT_BGRA;
+	frame.timestamp = os_gettime_ns();
+	obs_source_output_video(s->context, &frame);
+}
+
+static bool ptzsim_step_pan(obs_properties_t *, obs_property_t *, void *data)
+{
+	step_start((struct ptz_simulator*)data, step_axis_pan);
+	return false;
+}
+
+static bool ptzsim_step_tilt(obs_properties_t *, obs_property_t *, void *data)
+{
+	step_start((struct ptz_simulator*)data, step_axis_tilt);
+	return false;
+}
+
+static bool ptzsim_reset(obs_properties_t *, obs_property_t *, void *data)
+{
+	auto *s = (struct ptz_simulator*)data;
+	pthread_mutex_lock(&s->server->mutex);
+	s->subject[0] = s->subject[1] = 0.0f;
+	s->step_axis = step_axis_none;
+	s->server->camera.command_pantilt_absolute(0, 0, ptz_sim_camera::pan_speed_steps, ptz_sim_camera::tilt_speed_steps);
+	s->server->camera.command_zoom_absolute(0);
+	pthread_mutex_unlock(&s->server->mutex);
+	return false;
+}
+
+static obs_properties_t *ptzsim_properties(void *)
+{
+	obs_properties_t *props;
+	props = obs_properties_create();
+	obs_property_t *p;
+
+	obs_properties_add_path(props, "image", obs_module_text("Image file"), OBS_PATH_FILE,
+			"Image files (*.bmp *.jpg *.jpeg *.png *.gif)", NULL);
+	obs_properties_add_int(props, "width", obs_module_text("Width"), 16, 3840, 1);
+	obs_properties_add_int(props, "height", obs_module_text("Height"), 16, 2160, 1);
+	obs_properties_add_int(props, "port", obs_module_text("Port"), 1, 65535, 1);
+
+	{
+		obs_properties_t *pp = obs_properties_create();
+		obs_properties_add_int(pp, "image_pan_steps", obs_module_text("Pan steps across the image"), 100, 20000, 10);
+		obs_properties_add_int(pp, "fov_pan_steps", obs_module_text("Pan steps across the view at wide end"), 10, 20000, 10);
+		p = obs_properties_add_float(pp, "pan_speed_max", obs_module_text("Max pan speed"), 1.0, 20000.0, 10.0);
+		obs_property_float_set_suffix(p, " steps/s");
+		p = obs_properties_add_float(pp, "tilt_speed_max", obs_module_text("Max tilt speed"), 1.0, 20000.0, 10.0);
+		obs_property_float_set_suffix(p, " steps/s");
+		p = obs_properties_add_float(pp, "accel", obs_module_text("Acceleration"), 1.0, 100000.0, 100.0);
+		obs_property_float_set_suffix(p, " steps/s/s");
+		p = obs_properties_add_float(pp, "zoom_speed_max", obs_module_text("Max zoom speed"), 1.0, 100000.0, 100.0);
+		obs_property_float_set_suffix(p, " /s");
+		p = obs_properties_add_float(pp, "latency_ms", obs_module_text("Latency"), 0.0, 2000.0, 10.0);
+		obs_property_float_set_suffix(p, " ms");
+		obs_properties_add_group(props, "camera", obs_module_text("Camera"), OBS_GROUP_NORMAL, pp);
+	}
+
+	{
+		obs_properties_t *pp = obs_properties_create();
+		obs_properties_add_int(pp, "step_size", obs_module_text("Step size"), -10000, 10000, 10);
+		p = obs_properties_add_float(pp, "settle_band", obs_module_text("Settling band"), 0.1, 50.0, 0.1);
+		obs_property_float_set_suffix(p, " %");
+		p = obs_properties_add_float(pp, "step_duration", obs_module_text("Measurement duration"), 1.0, 60.0, 0.5);
+		obs_property_float_set_suffix(p, " s");
+		obs_properties_add_button(pp, "step_pan", obs_module_text("Step subject (pan)"), ptzsim_step_pan);
+		obs_properties_add_button(pp, "step_tilt", obs_module_text("Step subject (tilt)"), ptzsim_step_tilt);
+		obs_properties_add_button(pp, "reset", obs_module_text("Reset subject and camera"), ptzsim_reset);
+		obs_properties_add_group(props, "step", obs_module_text("Step response"), OBS_GROUP_NORMAL, pp);
+	}
+
+	return props;
+}
+
+static void ptzsim_get_defaults(obs_data_t *settings)
+{
+	obs_data_set_default_int(settings, "width", 1280);
+	obs_data_set_default_int(settings, "height", 720);
+	obs_data_set_default_int(settings, "port", 52381);
+	obs_data_set_default_int(settings, "image_pan_steps", 4000);
+	obs_data_set_default_int(settings, "fov_pan_steps", 1000);
+	obs_data_set_default_double(settings, "pan_speed_max", 1200.0);
+	obs_data_set_default_double(settings, "tilt_speed_max", 900.0);
+	obs_data_set_default_double(settings, "accel", 3000.0);
+	obs_data_set_default_double(settings, "zoom_speed_max", 8000.0);
+	obs_data_set_default_double(settings, "latency_ms", 100.0);
+	obs_data_set_default_int(settings, "step_size", 200);
+	obs_data_set_default_double(settings, "settle_band", 5.0);
+	obs_data_set_default_double(settings, "step_duration", 10.0);
+}
+
+static void cb_get_metrics(void *data, calldata_t *cd)
+{
+	auto *s = (struct ptz_simulator*)data;
+	pthread_mutex_lock(&s->server->mutex);
+	calldata_set_bool(cd, "running", s->step_axis != step_axis_none);
+	if (s->metrics_valid) {
+		calldata_set_float(cd, "settling_time", s->settling_time);
+		calldata_set_float(cd, "overshoot", s->overshoot);
+	}
+	pthread_mutex_unlock(&s->server->mutex);
+}
+
+extern "C"
+void register_ptz_simulator()
+{
+	struct obs_source_info info = {};
+	info.id = "face_tracker_ptz_simulator";
+	info.type = OBS_SOURCE_TYPE_INPUT;
+	info.output_flags = OBS_SOURCE_ASYNC_VIDEO | OBS_SOURCE_DO_NOT_DUPLICATE;
+	info.get_name = ptzsim_get_name;
+	info.create = ptzsim_create;
+	info.destroy = ptzsim_destroy;
+	info.update = ptzsim_update;
+	info.get_properties = ptzsim_properties;
+	info.get_defaults = ptzsim_get_defaults;
+	info.video_tick = ptzsim_tick;
+	obs_register_source(&info);
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <vector>
+#include "helper.hpp"
+
+/*
+ * Uniform grid over a set of rectangles to find overlapping pairs without
+ * comparing all of them.
+ * Usage: clear(), add() each rectangle, build(), then query().
+ * The buffers are kept across frames so that rebuilding won't allocate.
+ */
+class rect_grid
+{
+	struct item_s
+	{
+		rect_s rect;
+		int id;
+	};
+
+	std::vector<item_s> items;
+	std::vector<int> cell_start; // items of cell c are sorted[cell_start[c]] ... sorted[cell_start[c+1]-1]
+	std::vector<int> sorted;
+	int gx0, gy0, cell, nx, ny;
+
+	inline int cell_x(int x) const
+	{
+		int i = (x - gx0) / cell;
+		return i < 0 ? 0 : i >= nx ? nx - 1 : i;
+	}
+
+	inline int cell_y(int y) const
+	{
+		int i = (y - gy0) / cell;
+		return i < 0 ? 0 : i >= ny ? ny - 1 : i;
+	}
+
+	template <typename F> inline void for_each_cell(const rect_s &r, F f) const
+	{
+		const int cx1 = cell_x(r.x1 - 1);
+		const int cy1 = cell_y(r.y1 - 1);
+		for (int cy = cell_y(r.y0); cy <= cy1; cy++)
+			for (int cx = cell_x(r.x0); cx <= cx1; cx++)
+				f(cy * nx + cx);
+	}
+
+public:
+	rect_grid() { gx0 = gy0 = 0; cell = 1; nx = ny = 0; }
+
+	void clear() { items.clear(); nx = ny = 0; }
+
+	void add(const rect_s &r, int id)
+	{
+		if (r.x1 <= r.x0 || r.y1 <= r.y0)
+			return;
+		items.push_back(item_s{r, id});
+	}
+
+	size_t size() const { return items.size(); }
+
+	void build()
+	{
+		if (items.empty()) {
+			nx = ny = 0;
+			return;
+		}
+
+		int x0 = items[0].rect.x0, y0 = items[0].rect.y0;
+		int x1 = items[0].rect.x1, y1 = items[0].rect.y1;
+		double size_sum = 0.0;
+		for (const auto &it : items) {
+			if (it.rect.x0 < x0) x0 = it.rect.x0;
+			if (it.rect.y0 < y0) y0 = it.rect.y0;
+			if (it.rect.x1 > x1) x1 = it.rect.x1;
+			if (it.rect.y1 > y1) y1 = it.rect.y1;
+			size_sum += sqrt((double)get_area(it.rect));
+		}
+
+		// A cell about the size of a face keeps the number of cells per rectangle small.
+		cell = (int)(size_sum / items.size());
+		if (cell < 1)
+			cell = 1;
+		gx0 = x0;
+		gy0 = y0;
+		nx = (x1 - x0 + cell - 1) / cell;
+		ny = (y1 - y0 + cell - 1) / cell;
+		if (nx < 1) nx = 1;
+		if (ny < 1) ny = 1;
+
+		cell_start.assign(nx * ny + 1, 0);
+		for (const auto &it : items)
+			for_each_cell(it.rect, [this](int c) { cell_start[c + 1]++; });
+		for (int c = 0; c < nx * ny; c++)
+			cell_start[c + 1] += cell_start[c];
+
+		sorted.resize(cell_start[nx * ny]);
+		for (size_t i = 0; i < items.size(); i++)
+			for_each_cell(items[i].rect, [&](int c) { sorted[cell_start[c]++] = (int)i; });
+		for (int c = nx * ny; c > 0; c--)
+			cell_start[c] = cell_start[c - 1];
+		cell_start[0] = 0;
+	}
+
+	/*
+	 * Calls f(id, rect) once for each added rectangle that has a common area with r.
+	 * The order of the calls is not specified.
+	 */
+	template <typename F> void query(const rect_s &r, F f) const
+	{
+		if (nx <= 0 || r.x1 <= r.x0 || r.y1 <= r.y0)
+			return;
+
+		for_each_cell(r, [&](int c) {
+			for (int k = cell_start[c]; k < cell_start[c + 1]; k++) {
+				const item_s &it = items[sorted[k]];
+				if (common_area(r, it.rect) <= 0)
+					continue;
+				// An item spanning several cells is reported only at the cell having the top-left corner of the overlap.
+				int ox = r.x0 > it.rect.x0 ? r.x0 : it.rect.x0;
+				int oy = r.y0 > it.rect.y0 ? r.y0 : it.rect.y0;
+				if (cell_y(oy) * nx + cell_x(ox) != c)
+					continue;
+				f(it.id, it.rect);
+			}
+		});
+	}
+};
@@ -20,6 +20,7 @@ texture_object::texture_object()
 {
 	data = new texture_object_private_s;
 	data->obs_frame = NULL;
+	latency = 0;
 }
 
 texture_object::~texture_object()
@@ -57,6 +58,60 @@ static void obsframe2dlib_rgbx(dlib::matrix<dlib::rgb_pixel> &img, const struct
 	}
 }
 
+static void obsframe2dlib_y800(dlib::matrix<dlib::rgb_pixel> &img, const struct obs_source_frame *frame, int scale)
+{
+	const int nr = img.nr();
+	const int nc = img.nc();
+	for (int i=0; i<nr; i++) {
+		uint8_t *line = frame->data[0] + frame->linesize[0] * scale * i;
+		for (int j=0, js=0; j<nc; j++, js+=scale) {
+			img(i,j).red = line[js];
+			img(i,j).green = line[js];
+			img(i,j).blue = line[js];
+		}
+	}
+}
+
+static inline unsigned char rgb2luma(int r, int g, int b)
+{
+	// BT.601, same as the shader rgb2luma.effect
+	return (unsigned char)((r * 77 + g * 150 + b * 29 + 128) >> 8);
+}
+
+static void obsframe2dlib_gray_bgrx(dlib::matrix<unsigned char> &img, const struct obs_source_frame *frame, int scale, int size=4)
+{
+	const int nr = img.nr();
+	const int nc = img.nc();
+	const int inc = size * scale;
+	for (int i=0; i<nr; i++) {
+		uint8_t *line = frame->data[0] + frame->linesize[0] * scale * i;
+		for (int j=0, js=0; j<nc; j++, js+=inc)
+			img(i,j) = rgb2luma(line[js+2], line[js+1], line[js+0]);
+	}
+}
+
+static void obsframe2dlib_gray_rgbx(dlib::matrix<unsigned char> &img, const struct obs_source_frame *frame, int scale)
+{
+	const int nr = img.nr();
+	const int nc = img.nc();
+	for (int i=0; i<nr; i++) {
+		uint8_t *line = frame->data[0] + frame->linesize[0] * scale * i;
+		for (int j=0, js=0; j<nc; j++, js+=4*scale)
+			img(i,j) = rgb2luma(line[js+0], line[js+1], line[js+2]);
+	}
+}
+
+static void obsframe2dlib_gray_y800(dlib::matrix<unsigned char> &img, const struct obs_source_frame *frame, int scale)
+{
+	const int nr = img.nr();
+	const int nc = img.nc();
+	for (int i=0; i<nr; i++) {
+		uint8_t *line = frame->data[0] + frame->linesize[0] * scale * i;
+		for (int j=0, js=0; j<nc; j++, js+=scale)
+			img(i,j) = line[js];
+	}
+}
+
 static bool need_allocate_frame(const struct obs_source_frame *dst, const struct obs_source_frame *src)
 {
 	if (!dst)
@@ -82,6 +137,20 @@ void texture_object::set_texture_obsframe(const struct obs_source_frame *frame,
 	data->scale = scale;
 }
 
+int texture_object::get_width() const
+{
+	if (!data->obs_frame || data->scale <= 0)
+		return 0;
+	return data->obs_frame->width / data->scale;
+}
+
+int texture_object::get_height() const
+{
+	if (!data->obs_frame || data->scale <= 0)
+		return 0;
+	return data->obs_frame->height / data->scale;
+}
+
 bool texture_object::get_dlib_rgb_image(dlib::matrix<dlib::rgb_pixel> &img) const
 {
 	if (!data->obs_frame)
@@ -103,6 +172,9 @@ bool texture_object::get_dlib_rgb_image(dlib::matrix<dlib::rgb_pixel> &img) cons
 		case VIDEO_FORMAT_RGBA:
 			obsframe2dlib_rgbx(img, frame, scale);
 			break;
+		case VIDEO_FORMAT_Y800:
+			obsframe2dlib_y800(img, frame, scale);
+			break;
 		default:
 			if (TEST_FORMAT(frame->format))
 				blog(LOG_ERROR, "Frame format %d has to be RGB", (int)frame->format);
@@ -111,3 +183,36 @@ bool texture_object::get_dlib_rgb_image(dlib::matrix<dlib::rgb_pixel> &img) cons
 
 	return true;
 }
+
+bool texture_object::get_dlib_gray_image(dlib::matrix<unsigned char> &img) const
+{
+	if (!data->obs_frame)
+		return false;
+
+	const auto *frame = data->obs_frame;
+	const int scale = data->scale;
+	if (TEST_FORMAT(frame->format))
+		blog(LOG_INFO, "received frame format=%d", frame->format);
+	img.set_size(frame->height / scale, frame->width / scale);
+	switch(frame->format) {
+		case VIDEO_FORMAT_BGRX:
+		case VIDEO_FORMAT_BGRA:
+			obsframe2dlib_gray_bgrx(img, frame, scale);
+			break;
+		case VIDEO_FORMAT_BGR3:
+			obsframe2dlib_gray_bgrx(img, frame, scale, 3);
+			break;
+		case VIDEO_FORMAT_RGBA:
+			obsframe2dlib_gray_rgbx(img, frame, scale);
+			break;
+		case VIDEO_FORMAT_Y800:
+			obsframe2dlib_gray_y800(img, frame, scale);
+			break;
+		default:
+			if (TEST_FORMAT(frame->format))
+				blog(LOG_ERROR, "Frame format %d has to be RGB or Y800", (int)frame->format);
+	}
+	SET_FORMAT(frame->format);
+
+	return true;
+}
@@ -14,8 +14,12 @@ public:
 
 	void set_texture_obsframe(const struct obs_source_frame *frame, int scale);
 	bool get_dlib_rgb_image(dlib::matrix<dlib::rgb_pixel> &img) const;
+	bool get_dlib_gray_image(dlib::matrix<unsigned char> &img) const;
+	int get_width() const; // size of the image returned by get_dlib_*_image
+	int get_height() const;
 
 public:
 	int tick;
+	int latency; // frames between staging the texture and reading it back
 	float scale;
 };
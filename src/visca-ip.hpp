@@ -0,0 +1,127 @@
+#pragma once
+
+/*
+ * Framing of VISCA over IP (UDP)
+ *
+ * Each datagram has an 8-byte header followed by the payload.
+ *   byte 0-1: payload type
+ *   byte 2-3: payload length
+ *   byte 4-7: sequence number
+ * All the fields are big-endian.
+ * The camera returns the replies with the sequence number of the message.
+ */
+
+#include <cstdint>
+#include <cstddef>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET visca_ip_socket_t;
+#define VISCA_IP_INVALID_SOCKET INVALID_SOCKET
+#define visca_ip_closesocket closesocket
+#else // _WIN32
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <unistd.h>
+typedef int visca_ip_socket_t;
+#define VISCA_IP_INVALID_SOCKET (-1)
+#define visca_ip_closesocket close
+#endif // _WIN32
+
+#define VISCA_IP_DEFAULT_PORT 52381
+#define VISCA_IP_HEADER_SIZE 8
+#define VISCA_IP_PAYLOAD_MAX 16
+
+enum visca_ip_type_e
+{
+	visca_ip_type_command = 0x0100,
+	visca_ip_type_inquiry = 0x0110,
+	visca_ip_type_reply = 0x0111,
+	visca_ip_type_device_setting = 0x0120,
+	visca_ip_type_control = 0x0200,
+	visca_ip_type_control_reply = 0x0201,
+};
+
+// Payload of the control command and its reply
+#define VISCA_IP_CONTROL_RESET 0x01
+#define VISCA_IP_CONTROL_ERROR 0x0F
+#define VISCA_IP_CONTROL_ERROR_SEQUENCE 0x01
+#define VISCA_IP_CONTROL_ERROR_MESSAGE 0x02
+
+// The second byte of the VISCA reply, lower 4 bits are the socket number
+#define VISCA_REPLY_ACK 0x40
+#define VISCA_REPLY_COMPLETION 0x50
+#define VISCA_REPLY_ERROR 0x60
+
+// The third byte of the error reply
+#define VISCA_ERROR_SYNTAX 0x02
+#define VISCA_ERROR_BUFFER_FULL 0x03
+#define VISCA_ERROR_CANCELED 0x04
+#define VISCA_ERROR_NO_SOCKET 0x05
+#define VISCA_ERROR_NOT_EXECUTABLE 0x41
+
+struct visca_ip_message_s
+{
+	uint16_t type;
+	uint32_t seq;
+	uint8_t payload[VISCA_IP_PAYLOAD_MAX];
+	size_t len;
+};
+
+static inline size_t visca_ip_pack(uint8_t *buf, const visca_ip_message_s &m)
+{
+	buf[0] = (uint8_t)(m.type >> 8);
+	buf[1] = (uint8_t)m.type;
+	buf[2] = (uint8_t)(m.len >> 8);
+	buf[3] = (uint8_t)m.len;
+	buf[4] = (uint8_t)(m.seq >> 24);
+	buf[5] = (uint8_t)(m.seq >> 16);
+	buf[6] = (uint8_t)(m.seq >> 8);
+	buf[7] = (uint8_t)m.seq;
+	for (size_t i = 0; i < m.len; i++)
+		buf[VISCA_IP_HEADER_SIZE + i] = m.payload[i];
+	return VISCA_IP_HEADER_SIZE + m.len;
+}
+
+// Returns false if the datagram is not a valid message.
+static inline bool visca_ip_unpack(visca_ip_message_s &m, const uint8_t *buf, size_t size)
+{
+	if (size < VISCA_IP_HEADER_SIZE)
+		return false;
+	m.type = (uint16_t)(buf[0] << 8 | buf[1]);
+	m.len = (size_t)(buf[2] << 8 | buf[3]);
+	m.seq = (uint32_t)buf[4] << 24 | (uint32_t)buf[5] << 16 | (uint32_t)buf[6] << 8 | (uint32_t)buf[7];
+	if (m.len > VISCA_IP_PAYLOAD_MAX || VISCA_IP_HEADER_SIZE + m.len > size)
+		return false;
+	for (size_t i = 0; i < m.len; i++)
+		m.payload[i] = buf[VISCA_IP_HEADER_SIZE + i];
+	return true;
+}
+
+static inline void visca_ip_set_payload(visca_ip_message_s &m, const uint8_t *p, size_t len)
+{
+	m.len = len < VISCA_IP_PAYLOAD_MAX ? len : VISCA_IP_PAYLOAD_MAX;
+	for (size_t i = 0; i < m.len; i++)
+		m.payload[i] = p[i];
+}
+
+// Returns the value of 4 nibbles such as the zoom position `0p 0q 0r 0s`.
+static inline int visca_nibbles_to_int(const uint8_t *p, int n)
+{
+	int v = 0;
+	for (int i = 0; i < n; i++)
+		v = (v << 4) | (p[i] & 0x0F);
+	return v;
+}
+
+static inline void visca_int_to_nibbles(uint8_t *p, int v, int n)
+{
+	for (int i = n - 1; i >= 0; i--) {
+		p[i] = (uint8_t)(v & 0x0F);
+		v >>= 4;
+	}
+}
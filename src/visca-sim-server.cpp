@@ -0,0 +1,234 @@
+#include <obs-module.h>
+#include <util/platform.h>
+#include <cstring>
+#include "plugin-macros.generated.h"
+#include "visca-sim-server.hpp"
+
+#define debug(...) blog(LOG_INFO, __VA_ARGS__)
+
+#define WAIT_MAX_MS 250 // The thread wakes up at this interval to check it should stop.
+#define SIM_SOCKET 1 // The command is always executed on the socket 1.
+
+visca_sim_server::visca_sim_server()
+{
+#ifdef _WIN32
+	WSADATA wsa;
+	WSAStartup(MAKEWORD(2, 2), &wsa);
+#endif
+	pthread_mutex_init(&mutex, 0);
+}
+
+visca_sim_server::~visca_sim_server()
+{
+	stop();
+	pthread_mutex_destroy(&mutex);
+#ifdef _WIN32
+	WSACleanup();
+#endif
+}
+
+bool visca_sim_server::start(int port)
+{
+	stop();
+
+	sock = socket(AF_INET, SOCK_DGRAM, 0);
+	if (sock == VISCA_IP_INVALID_SOCKET) {
+		blog(LOG_ERROR, "visca_sim_server: failed to create socket");
+		return false;
+	}
+
+	struct sockaddr_in addr = {};
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons((uint16_t)port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(sock, (const struct sockaddr *)&addr, sizeof(addr)) != 0) {
+		blog(LOG_ERROR, "visca_sim_server: failed to bind 127.0.0.1:%d", port);
+		visca_ip_closesocket(sock);
+		sock = VISCA_IP_INVALID_SOCKET;
+		return false;
+	}
+
+	stop_requested = false;
+	pthread_create(&thread, NULL, visca_sim_server::thread_main, (void*)this);
+	thread_started = true;
+	debug("visca_sim_server: listening on 127.0.0.1:%d", port);
+	return true;
+}
+
+void visca_sim_server::stop()
+{
+	if (thread_started) {
+		os_atomic_set_bool(&stop_requested, true);
+		pthread_join(thread, NULL);
+		thread_started = false;
+	}
+	if (sock != VISCA_IP_INVALID_SOCKET) {
+		visca_ip_closesocket(sock);
+		sock = VISCA_IP_INVALID_SOCKET;
+	}
+}
+
+void *visca_sim_server::thread_main(void *data)
+{
+	os_set_thread_name("visca-sim");
+	auto *server = (visca_sim_server*)data;
+	server->thread_loop();
+	return NULL;
+}
+
+void visca_sim_server::thread_loop()
+{
+	while (!os_atomic_load_bool(&stop_requested)) {
+		struct timeval tv;
+		tv.tv_sec = 0;
+		tv.tv_usec = WAIT_MAX_MS * 1000;
+		fd_set fds;
+		FD_ZERO(&fds);
+		FD_SET(sock, &fds);
+		if (select((int)sock + 1, &fds, NULL, NULL, &tv) <= 0)
+			continue;
+
+		uint8_t buf[VISCA_IP_HEADER_SIZE + VISCA_IP_PAYLOAD_MAX];
+		struct sockaddr_storage from;
+		socklen_t fromlen = sizeof(from);
+		int n = (int)recvfrom(sock, (char *)buf, sizeof(buf), 0, (struct sockaddr *)&from, &fromlen);
+		if (n <= 0)
+			continue;
+
+		visca_ip_message_s msg;
+		if (visca_ip_unpack(msg, buf, (size_t)n))
+			handle_message(msg, (const struct sockaddr *)&from, (int)fromlen);
+	}
+}
+
+void visca_sim_server::send_reply(uint16_t type, uint32_t seq, const uint8_t *p, size_t len, const struct sockaddr *addr, int addrlen)
+{
+	visca_ip_message_s msg;
+	msg.type = type;
+	msg.seq = seq;
+	visca_ip_set_payload(msg, p, len);
+	uint8_t buf[VISCA_IP_HEADER_SIZE + VISCA_IP_PAYLOAD_MAX];
+	size_t n = visca_ip_pack(buf, msg);
+	sendto(sock, (const char *)buf, (int)n, 0, addr, addrlen);
+}
+
+// Sends the ack, the completion, or the error of VISCA with the socket number.
+void visca_sim_server::send_status(uint32_t seq, uint8_t status, uint8_t error, const struct sockaddr *addr, int addrlen)
+{
+	uint8_t p[4] = {0x90, (uint8_t)(status | SIM_SOCKET)};
+	size_t n = 2;
+	if (status == VISCA_REPLY_ERROR)
+		p[n++] = error;
+	p[n++] = 0xFF;
+	send_reply(visca_ip_type_reply, seq, p, n, addr, addrlen);
+}
+
+void visca_sim_server::handle_message(const visca_ip_message_s &msg, const struct sockaddr *addr, int addrlen)
+{
+	if (msg.type == visca_ip_type_control) {
+		// Sequence numbers are not checked, so the reset has nothing to do.
+		const uint8_t ack[] = {VISCA_IP_CONTROL_RESET};
+		send_reply(visca_ip_type_control_reply, msg.seq, ack, sizeof(ack), addr, addrlen);
+		return;
+	}
+
+	if (msg.type == visca_ip_type_command) {
+		if (handle_command(msg.payload, msg.len)) {
+			send_status(msg.seq, VISCA_REPLY_ACK, 0, addr, addrlen);
+			send_status(msg.seq, VISCA_REPLY_COMPLETION, 0, addr, addrlen);
+		}
+		else {
+			send_status(msg.seq, VISCA_REPLY_ERROR, VISCA_ERROR_SYNTAX, addr, addrlen);
+		}
+		return;
+	}
+
+	if (msg.type == visca_ip_type_inquiry) {
+		uint8_t reply[VISCA_IP_PAYLOAD_MAX];
+		size_t n = handle_inquiry(msg.payload, msg.len, reply);
+		if (n)
+			send_reply(visca_ip_type_reply, msg.seq, reply, n, addr, addrlen);
+		else
+			send_status(msg.seq, VISCA_REPLY_ERROR, VISCA_ERROR_SYNTAX, addr, addrlen);
+	}
+}
+
+// Returns false if the command is not supported.
+bool visca_sim_server::handle_command(const uint8_t *p, size_t len)
+{
+	if (len < 5 || p[1] != 0x01)
+		return false;
+
+	bool ret = true;
+	pthread_mutex_lock(&mutex);
+	if (len == 9 && p[2] == 0x06 && p[3] == 0x01) {
+		// Pan-tilt drive: 81 01 06 01 VV WW XX YY FF, XX 1=left 2=right, YY 1=up 2=down
+		int pan = p[6] == 0x01 ? -p[4] : p[6] == 0x02 ? p[4] : 0;
+		int tilt = p[7] == 0x01 ? p[5] : p[7] == 0x02 ? -p[5] : 0; // tilt position increases upward
+		camera.command_pantilt_speed(pan, tilt);
+	}
+	else if (len == 15 && p[2] == 0x06 && (p[3] == 0x02 || p[3] == 0x03)) {
+		// Pan-tilt absolute or relative position: 81 01 06 02 VV WW 0Y0Y0Y0Y 0Z0Z0Z0Z FF
+		int pan = (int16_t)visca_nibbles_to_int(p + 6, 4);
+		int tilt = (int16_t)visca_nibbles_to_int(p + 10, 4);
+		if (p[3] == 0x02)
+			camera.command_pantilt_absolute(pan, tilt, p[4], p[5]);
+		else
+			camera.command_pantilt_relative(pan, tilt, p[4], p[5]);
+	}
+	else if (len == 5 && p[2] == 0x06 && p[3] == 0x04) {
+		// Home
+		camera.command_pantilt_absolute(0, 0, ptz_sim_camera::pan_speed_steps, ptz_sim_camera::tilt_speed_steps);
+	}
+	else if (len == 6 && p[2] == 0x04 && p[3] == 0x07) {
+		// Zoom: 81 01 04 07 2p FF for tele, 3p for wide, 00 for stop
+		int speed = (p[4] & 0x0F) + 1;
+		camera.command_zoom_speed((p[4] & 0xF0) == 0x20 ? speed : (p[4] & 0xF0) == 0x30 ? -speed : 0);
+	}
+	else if (len == 9 && p[2] == 0x04 && p[3] == 0x47) {
+		// Zoom direct: 81 01 04 47 0p0q0r0s FF
+		camera.command_zoom_absolute(visca_nibbles_to_int(p + 4, 4));
+	}
+	else if (len == 7 && p[2] == 0x04 && p[3] == 0x3F) {
+		// Memory; the simulator does not have presets and moves to home for a recall.
+		if (p[4] == 0x02) {
+			camera.command_pantilt_absolute(0, 0, ptz_sim_camera::pan_speed_steps, ptz_sim_camera::tilt_speed_steps);
+			camera.command_zoom_absolute(0);
+		}
+	}
+	else {
+		ret = false;
+	}
+	pthread_mutex_unlock(&mutex);
+	return ret;
+}
+
+// Returns the length of the reply, or 0 if the inquiry is not supported.
+size_t visca_sim_server::handle_inquiry(const uint8_t *p, size_t len, uint8_t *reply)
+{
+	if (len != 5 || p[1] != 0x09)
+		return 0;
+
+	pthread_mutex_lock(&mutex);
+	const int pan = (int)roundf(camera.pan);
+	const int tilt = (int)roundf(camera.tilt);
+	const int zoom = (int)roundf(camera.zoom);
+	pthread_mutex_unlock(&mutex);
+
+	reply[0] = 0x90;
+	reply[1] = VISCA_REPLY_COMPLETION;
+	if (p[2] == 0x04 && p[3] == 0x47) {
+		// Zoom position: 90 50 0p 0q 0r 0s FF
+		visca_int_to_nibbles(reply + 2, zoom & 0xFFFF, 4);
+		reply[6] = 0xFF;
+		return 7;
+	}
+	if (p[2] == 0x06 && p[3] == 0x12) {
+		// Pan-tilt position: 90 50 0w 0w 0w 0w 0z 0z 0z 0z FF
+		visca_int_to_nibbles(reply + 2, pan & 0xFFFF, 4);
+		visca_int_to_nibbles(reply + 6, tilt & 0xFFFF, 4);
+		reply[10] = 0xFF;
+		return 11;
+	}
+	return 0;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <util/threading.h>
+#include "visca-ip.hpp"
+#include "ptz-sim-camera.hpp"
+
+/*
+ * Fake camera that speaks VISCA over IP on UDP for the simulator.
+ * It listens on the loopback address and drives ptz_sim_camera by the commands.
+ * Every command is acknowledged and completed at once; the motion follows the model.
+ */
+class visca_sim_server
+{
+	pthread_t thread;
+	bool thread_started = false;
+	volatile bool stop_requested = false;
+	visca_ip_socket_t sock = VISCA_IP_INVALID_SOCKET;
+
+	static void *thread_main(void *);
+	void thread_loop();
+	void handle_message(const visca_ip_message_s &msg, const struct sockaddr *addr, int addrlen);
+	bool handle_command(const uint8_t *p, size_t len);
+	size_t handle_inquiry(const uint8_t *p, size_t len, uint8_t *reply);
+	void send_reply(uint16_t type, uint32_t seq, const uint8_t *p, size_t len, const struct sockaddr *addr, int addrlen);
+	void send_status(uint32_t seq, uint8_t status, uint8_t error, const struct sockaddr *addr, int addrlen);
+
+public:
+	// Protects the camera, which is also ticked by the simulator source.
+	// The simulator source also protects its subject and step response by this.
+	pthread_mutex_t mutex;
+	ptz_sim_camera camera;
+
+	visca_sim_server();
+	~visca_sim_server();
+
+	bool start(int port);
+	void stop();
+};
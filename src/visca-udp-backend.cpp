@@ -0,0 +1,599 @@
+#include <obs-module.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include <climits>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include "plugin-macros.generated.h"
+#include "visca-udp-backend.hpp"
+
+#define debug(...) blog(LOG_INFO, __VA_ARGS__)
+
+#define ZOOM_POLL_MIN_MS 20
+#define ZOOM_POLL_DEFAULT_MS 100
+#define RECONNECT_WAIT_MS 50
+#define RECEIVE_SLICE_MS 5 // While a socket is free, new requests are checked at this interval.
+#define WAIT_MAX_MS 250 // The thread also wakes up at this interval to check it is still referenced.
+#define RETRY_MAX 3
+#define COMPLETION_TIMEOUT_NS 10000000000ULL // A preset recall completes after the camera stops.
+
+visca_udp_backend::visca_udp_backend()
+{
+	debug("visca_udp_backend::visca_udp_backend");
+#ifdef _WIN32
+	WSADATA wsa;
+	WSAStartup(MAKEWORD(2, 2), &wsa);
+#endif
+	data = NULL;
+	data_changed = false;
+	preset_changed = false;
+	pan_rsvd = 0;
+	tilt_rsvd = 0;
+	zoom_rsvd = 0;
+	preset_rsvd = 0;
+	zoom_got = 0;
+	zoom_poll_ms = ZOOM_POLL_DEFAULT_MS;
+	pantilt_pos_mode = false;
+	zoom_pos_mode = false;
+	pantilt_pos_rsvd = ptz_position_request_s();
+	zoom_pos_rsvd = 0;
+	zoom_pos_cnt = 0;
+	position_wanted = false;
+	position_got_valid = false;
+	pan_got = 0;
+	tilt_got = 0;
+	sock = VISCA_IP_INVALID_SOCKET;
+	seq = 0;
+	next_send_ns = 0;
+	n_inflight = 0;
+	pan_sent = tilt_sent = zoom_sent = INT_MIN;
+	pantilt_pos_sent = 0;
+	zoom_pos_sent = 0;
+	zoom_poll_next_ns = 0;
+	position_poll_next_ns = 0;
+	pthread_mutex_init(&mutex, 0);
+	os_event_init(&event, OS_EVENT_TYPE_AUTO);
+
+	pthread_create(&thread, NULL, visca_udp_backend::thread_main, (void*)this);
+	pthread_detach(thread);
+}
+
+visca_udp_backend::~visca_udp_backend()
+{
+	if (sock != VISCA_IP_INVALID_SOCKET)
+		visca_ip_closesocket(sock);
+	if (data)
+		obs_data_release(data);
+	os_event_destroy(event);
+	pthread_mutex_destroy(&mutex);
+#ifdef _WIN32
+	WSACleanup();
+#endif
+}
+
+void *visca_udp_backend::thread_main(void *data)
+{
+	os_set_thread_name("visca-udp");
+	auto *visca = (visca_udp_backend*)data;
+	visca->add_ref();
+	visca->thread_loop();
+	visca->release();
+	return NULL;
+}
+
+void visca_udp_backend::thread_connect()
+{
+	pthread_mutex_lock(&mutex);
+	char *address = bstrdup(obs_data_get_string(data, "address"));
+	int port = (int)obs_data_get_int(data, "port");
+	data_changed = false;
+	pthread_mutex_unlock(&mutex);
+
+	if (sock != VISCA_IP_INVALID_SOCKET) {
+		visca_ip_closesocket(sock);
+		sock = VISCA_IP_INVALID_SOCKET;
+	}
+
+	char port_str[8];
+	snprintf(port_str, sizeof(port_str), "%d", port);
+	struct addrinfo hints = {};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	struct addrinfo *res = NULL;
+	debug("visca_udp_backend::thread_connect connecting to address=%s port=%d...", address, port);
+	if (getaddrinfo(address, port_str, &hints, &res) != 0 || !res) {
+		blog(LOG_ERROR, "failed to resolve %s:%d", address, port);
+		bfree(address);
+		return;
+	}
+
+	for (struct addrinfo *ai = res; ai; ai = ai->ai_next) {
+		visca_ip_socket_t s = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (s == VISCA_IP_INVALID_SOCKET)
+			continue;
+		// Connecting a UDP socket only sets the default destination and filters the replies from the others.
+		if (connect(s, ai->ai_addr, (int)ai->ai_addrlen) == 0) {
+			sock = s;
+			break;
+		}
+		visca_ip_closesocket(s);
+	}
+	freeaddrinfo(res);
+
+	if (sock == VISCA_IP_INVALID_SOCKET) {
+		blog(LOG_ERROR, "failed to connect %s:%d", address, port);
+		bfree(address);
+		return;
+	}
+	bfree(address);
+
+	rtt.reset();
+	next_send_ns = 0;
+	zoom_poll_next_ns = 0;
+	position_poll_next_ns = 0;
+	reset_sequence();
+	debug("visca_udp_backend::thread_connect exiting successfully");
+}
+
+bool visca_udp_backend::send_message(const visca_ip_message_s &msg)
+{
+	uint8_t buf[VISCA_IP_HEADER_SIZE + VISCA_IP_PAYLOAD_MAX];
+	size_t n = visca_ip_pack(buf, msg);
+	return send(sock, (const char *)buf, (int)n, 0) == (int)n;
+}
+
+/*
+ * Resets the sequence number of the camera and ours.
+ * The commands in flight are given up and the latest requests will be sent again.
+ */
+bool visca_udp_backend::reset_sequence()
+{
+	while (n_inflight > 0)
+		remove_inflight(n_inflight - 1, true);
+
+	visca_ip_message_s msg;
+	msg.type = visca_ip_type_control;
+	msg.seq = 0;
+	msg.payload[0] = VISCA_IP_CONTROL_RESET;
+	msg.len = 1;
+	seq = 1;
+	return send_message(msg);
+}
+
+bool visca_udp_backend::is_inflight(cmd_kind_e kind) const
+{
+	for (int i = 0; i < n_inflight; i++) {
+		if (inflight[i].kind == kind)
+			return true;
+	}
+	return false;
+}
+
+int visca_udp_backend::count_commands() const
+{
+	int n = 0;
+	for (int i = 0; i < n_inflight; i++) {
+		if (inflight[i].kind != cmd_kind_zoom_inquiry && inflight[i].kind != cmd_kind_position_inquiry)
+			n++;
+	}
+	return n;
+}
+
+visca_udp_backend::inflight_s &visca_udp_backend::send_command(cmd_kind_e kind, uint16_t type, const uint8_t *payload, size_t len)
+{
+	inflight_s &f = inflight[n_inflight++];
+	f.msg.type = type;
+	f.msg.seq = seq++;
+	visca_ip_set_payload(f.msg, payload, len);
+	f.kind = kind;
+	f.sent_ns = os_gettime_ns();
+	f.retry = 0;
+	f.acked = false;
+	f.position = false;
+	f.relative = false;
+	f.cnt = 0;
+	if (!send_message(f.msg))
+		blog(LOG_WARNING, "visca_udp_backend: failed to send a message");
+	next_send_ns = f.sent_ns + rtt.pacing_ns();
+	return f;
+}
+
+static inline int clamp_speed(int v, int max)
+{
+	return v < 1 ? 1 : v > max ? max : v;
+}
+
+/*
+ * Sends one message if a socket of the camera is free.
+ * The speeds are read just before sending so that the requests
+ * that arrived while the sockets are busy are coalesced into the latest one.
+ * The inquiries do not take a command socket and are sent regardless of the commands in flight.
+ */
+bool visca_udp_backend::send_next(uint64_t ns)
+{
+	if (ns < next_send_ns)
+		return false;
+
+	if (count_commands() < 2) {
+		if (!is_inflight(cmd_kind_preset) && os_atomic_exchange_bool(&preset_changed, false)) {
+			const uint8_t p[] = {0x81, 0x01, 0x04, 0x3F, 0x02, (uint8_t)(preset_rsvd & 0x7F), 0xFF};
+			send_command(cmd_kind_preset, visca_ip_type_command, p, sizeof(p));
+			return true;
+		}
+
+		if (os_atomic_load_bool(&pantilt_pos_mode)) {
+			pthread_mutex_lock(&mutex);
+			ptz_position_request_s req = pantilt_pos_rsvd;
+			pthread_mutex_unlock(&mutex);
+			if (!is_inflight(cmd_kind_pantilt) && req.cnt != pantilt_pos_sent) {
+				uint8_t p[15] = {0x81, 0x01, 0x06, (uint8_t)(req.relative ? 0x03 : 0x02),
+					(uint8_t)clamp_speed(req.speed_pan, 0x18), (uint8_t)clamp_speed(req.speed_tilt, 0x17)};
+				visca_int_to_nibbles(p + 6, req.pan & 0xFFFF, 4);
+				visca_int_to_nibbles(p + 10, req.tilt & 0xFFFF, 4);
+				p[14] = 0xFF;
+				inflight_s &f = send_command(cmd_kind_pantilt, visca_ip_type_command, p, sizeof(p));
+				f.position = true;
+				f.relative = req.relative;
+				f.cnt = (long)req.cnt;
+				pantilt_pos_sent = req.cnt;
+				pan_sent = tilt_sent = INT_MIN; // the next speed has to be sent even if unchanged
+				return true;
+			}
+		}
+		else {
+			int pan = os_atomic_load_long(&pan_rsvd);
+			int tilt = os_atomic_load_long(&tilt_rsvd);
+			if (!is_inflight(cmd_kind_pantilt) && (pan != pan_sent || tilt != tilt_sent)) {
+				const uint8_t p[] = {
+					0x81, 0x01, 0x06, 0x01,
+					(uint8_t)clamp_speed(std::abs(pan), 0x18),
+					(uint8_t)clamp_speed(std::abs(tilt), 0x17),
+					(uint8_t)(pan < 0 ? 0x01 : pan > 0 ? 0x02 : 0x03), // 1=left, 2=right
+					(uint8_t)(tilt < 0 ? 0x01 : tilt > 0 ? 0x02 : 0x03), // 1=up, 2=down
+					0xFF,
+				};
+				send_command(cmd_kind_pantilt, visca_ip_type_command, p, sizeof(p));
+				pan_sent = pan;
+				tilt_sent = tilt;
+				return true;
+			}
+		}
+
+		if (os_atomic_load_bool(&zoom_pos_mode)) {
+			long cnt = os_atomic_load_long(&zoom_pos_cnt);
+			if (!is_inflight(cmd_kind_zoom) && cnt != zoom_pos_sent) {
+				uint8_t p[9] = {0x81, 0x01, 0x04, 0x47};
+				visca_int_to_nibbles(p + 4, (int)os_atomic_load_long(&zoom_pos_rsvd) & 0xFFFF, 4);
+				p[8] = 0xFF;
+				inflight_s &f = send_command(cmd_kind_zoom, visca_ip_type_command, p, sizeof(p));
+				f.position = true;
+				f.cnt = cnt;
+				zoom_pos_sent = cnt;
+				zoom_sent = INT_MIN;
+				return true;
+			}
+		}
+		else {
+			int zoom = os_atomic_load_long(&zoom_rsvd);
+			if (!is_inflight(cmd_kind_zoom) && zoom != zoom_sent) {
+				int zoom_a = std::abs(zoom);
+				if (zoom_a > 7) zoom_a = 7;
+				// zoom>0 : wide
+				const uint8_t p[] = {0x81, 0x01, 0x04, 0x07, (uint8_t)(zoom > 0 ? 0x30 | zoom_a : zoom < 0 ? 0x20 | zoom_a : 0x00), 0xFF};
+				send_command(cmd_kind_zoom, visca_ip_type_command, p, sizeof(p));
+				zoom_sent = zoom;
+				return true;
+			}
+		}
+	}
+
+	// Zoom is polled at its own interval regardless of how often the speed is requested.
+	if (!is_inflight(cmd_kind_zoom_inquiry) && ns >= zoom_poll_next_ns) {
+		const uint8_t p[] = {0x81, 0x09, 0x04, 0x47, 0xFF};
+		send_command(cmd_kind_zoom_inquiry, visca_ip_type_inquiry, p, sizeof(p));
+		zoom_poll_next_ns = ns + os_atomic_load_long(&zoom_poll_ms) * 1000000ULL;
+		return true;
+	}
+
+	// The position is inquired only after someone is interested in it.
+	if (os_atomic_load_bool(&position_wanted) && !is_inflight(cmd_kind_position_inquiry) && ns >= position_poll_next_ns) {
+		const uint8_t p[] = {0x81, 0x09, 0x06, 0x12, 0xFF};
+		send_command(cmd_kind_position_inquiry, visca_ip_type_inquiry, p, sizeof(p));
+		position_poll_next_ns = ns + os_atomic_load_long(&zoom_poll_ms) * 1000000ULL;
+		return true;
+	}
+
+	return false;
+}
+
+// Returns true if a request is waiting for a free socket or the interval after the previous message.
+bool visca_udp_backend::has_pending()
+{
+	if (os_atomic_load_bool(&preset_changed) && !is_inflight(cmd_kind_preset))
+		return true;
+	if (!is_inflight(cmd_kind_pantilt)) {
+		if (os_atomic_load_bool(&pantilt_pos_mode)) {
+			pthread_mutex_lock(&mutex);
+			unsigned int cnt = pantilt_pos_rsvd.cnt;
+			pthread_mutex_unlock(&mutex);
+			if (cnt != pantilt_pos_sent)
+				return true;
+		}
+		else if (os_atomic_load_long(&pan_rsvd) != pan_sent || os_atomic_load_long(&tilt_rsvd) != tilt_sent)
+			return true;
+	}
+	if (!is_inflight(cmd_kind_zoom)) {
+		if (os_atomic_load_bool(&zoom_pos_mode)) {
+			if (os_atomic_load_long(&zoom_pos_cnt) != zoom_pos_sent)
+				return true;
+		}
+		else if (os_atomic_load_long(&zoom_rsvd) != zoom_sent)
+			return true;
+	}
+	return false;
+}
+
+void visca_udp_backend::remove_inflight(int i, bool failed)
+{
+	/* If failed, the latest request of the same kind will be sent again.
+	 * An absolute position move is sent again only if no later move has been sent.
+	 * A relative move is not sent again since the camera might have moved by it. */
+	const inflight_s &f = inflight[i];
+	if (failed) {
+		switch (f.kind) {
+			case cmd_kind_pantilt:
+				if (!f.position)
+					pan_sent = tilt_sent = INT_MIN;
+				else if (!f.relative && pantilt_pos_sent == (unsigned int)f.cnt)
+					pantilt_pos_sent--;
+				break;
+			case cmd_kind_zoom:
+				if (!f.position)
+					zoom_sent = INT_MIN;
+				else if (zoom_pos_sent == f.cnt)
+					zoom_pos_sent--;
+				break;
+			case cmd_kind_preset:
+				os_atomic_set_bool(&preset_changed, true);
+				break;
+			default:
+				break;
+		}
+	}
+	inflight[i] = inflight[--n_inflight];
+}
+
+void visca_udp_backend::handle_reply(const visca_ip_message_s &msg, uint64_t ns)
+{
+	if (msg.type == visca_ip_type_control_reply) {
+		if (msg.len >= 2 && msg.payload[0] == VISCA_IP_CONTROL_ERROR) {
+			blog(LOG_WARNING, "visca_udp_backend: camera returned error %02x for the message, resetting sequence number", msg.payload[1]);
+			reset_sequence();
+		}
+		return;
+	}
+
+	if (msg.type != visca_ip_type_reply || msg.len < 3)
+		return;
+
+	int i = 0;
+	while (i < n_inflight && inflight[i].msg.seq != msg.seq)
+		i++;
+	if (i >= n_inflight)
+		return; // reply to a retransmitted message or the completion of a position move, already handled
+
+	inflight_s &f = inflight[i];
+	switch (msg.payload[1] & 0xF0) {
+		case VISCA_REPLY_ACK:
+			if (!f.acked && f.retry == 0)
+				rtt.update((int64_t)(ns - f.sent_ns));
+			f.acked = true;
+			// A position move runs until the camera arrives. Let the next request replace it.
+			if (f.position)
+				remove_inflight(i, false);
+			break;
+		case VISCA_REPLY_COMPLETION:
+			if (!f.acked && f.retry == 0)
+				rtt.update((int64_t)(ns - f.sent_ns));
+			if (f.kind == cmd_kind_zoom_inquiry && msg.len >= 7) {
+				int zoom_cur = visca_nibbles_to_int(msg.payload + 2, 4);
+				os_atomic_set_long(&zoom_got, zoom_cur);
+			}
+			if (f.kind == cmd_kind_position_inquiry && msg.len >= 11) {
+				os_atomic_set_long(&pan_got, (int16_t)visca_nibbles_to_int(msg.payload + 2, 4));
+				os_atomic_set_long(&tilt_got, (int16_t)visca_nibbles_to_int(msg.payload + 6, 4));
+				os_atomic_set_bool(&position_got_valid, true);
+			}
+			remove_inflight(i, false);
+			break;
+		case VISCA_REPLY_ERROR:
+			if (msg.payload[2] == VISCA_ERROR_BUFFER_FULL || msg.payload[2] == VISCA_ERROR_NO_SOCKET) {
+				// The camera is busy, wait longer before sending the next message.
+				next_send_ns = ns + rtt.timeout_ns();
+				remove_inflight(i, true);
+			}
+			else {
+				// Retrying does not help, e.g. zoom at its end.
+				debug("visca_udp_backend: camera returned error %02x", msg.payload[2]);
+				remove_inflight(i, false);
+			}
+			break;
+	}
+}
+
+void visca_udp_backend::receive(uint64_t timeout_ns)
+{
+	struct timeval tv;
+	tv.tv_sec = (long)(timeout_ns / 1000000000);
+	tv.tv_usec = (long)(timeout_ns % 1000000000 / 1000);
+
+	for (;;) {
+		fd_set fds;
+		FD_ZERO(&fds);
+		FD_SET(sock, &fds);
+		if (select((int)sock + 1, &fds, NULL, NULL, &tv) <= 0)
+			return;
+
+		uint8_t buf[VISCA_IP_HEADER_SIZE + VISCA_IP_PAYLOAD_MAX];
+		int n = (int)recv(sock, (char *)buf, sizeof(buf), 0);
+		if (n <= 0)
+			return;
+		visca_ip_message_s msg;
+		if (visca_ip_unpack(msg, buf, (size_t)n))
+			handle_reply(msg, os_gettime_ns());
+
+		// Drain the other datagrams without waiting.
+		tv.tv_sec = 0;
+		tv.tv_usec = 0;
+	}
+}
+
+void visca_udp_backend::retransmit_expired(uint64_t ns)
+{
+	for (int i = n_inflight - 1; i >= 0; i--) {
+		inflight_s &f = inflight[i];
+		if (f.acked) {
+			if (ns >= f.sent_ns + COMPLETION_TIMEOUT_NS)
+				remove_inflight(i, false);
+			continue;
+		}
+
+		if (ns < f.sent_ns + (rtt.timeout_ns() << f.retry))
+			continue;
+
+		if (f.retry >= RETRY_MAX) {
+			blog(LOG_WARNING, "visca_udp_backend: no reply from the camera, resetting sequence number");
+			reset_sequence();
+			return;
+		}
+
+		f.retry++;
+		f.sent_ns = ns;
+		send_message(f.msg);
+	}
+}
+
+void visca_udp_backend::thread_loop()
+{
+	while (get_ref() > 1) {
+		if (data_changed)
+			thread_connect();
+		if (sock == VISCA_IP_INVALID_SOCKET) {
+			os_event_timedwait(event, RECONNECT_WAIT_MS);
+			continue;
+		}
+
+		uint64_t ns = os_gettime_ns();
+		while (send_next(ns))
+			ns = os_gettime_ns();
+		retransmit_expired(ns);
+
+		uint64_t wake_ns = ns + WAIT_MAX_MS * 1000000ULL;
+		const bool socket_free = count_commands() < 2;
+		uint64_t t = is_inflight(cmd_kind_zoom_inquiry) ? wake_ns : zoom_poll_next_ns;
+		if (os_atomic_load_bool(&position_wanted) && !is_inflight(cmd_kind_position_inquiry) && position_poll_next_ns < t)
+			t = position_poll_next_ns;
+		if (socket_free && has_pending())
+			t = ns;
+		if (t < next_send_ns)
+			t = next_send_ns;
+		if (t < wake_ns)
+			wake_ns = t;
+		for (int i = 0; i < n_inflight; i++) {
+			uint64_t t = inflight[i].acked ?
+				inflight[i].sent_ns + COMPLETION_TIMEOUT_NS :
+				inflight[i].sent_ns + (rtt.timeout_ns() << inflight[i].retry);
+			if (t < wake_ns)
+				wake_ns = t;
+		}
+		uint64_t wait_ns = wake_ns > ns ? wake_ns - ns : 0;
+		if (wait_ns < 1000000ULL)
+			wait_ns = 1000000ULL;
+
+		if (n_inflight > 0) {
+			if (socket_free && wait_ns > RECEIVE_SLICE_MS * 1000000ULL)
+				wait_ns = RECEIVE_SLICE_MS * 1000000ULL;
+			receive(wait_ns);
+		}
+		else {
+			os_event_timedwait(event, (unsigned long)((wait_ns + 999999) / 1000000));
+		}
+	}
+}
+
+bool visca_udp_backend::get_position(int &pan, int &tilt)
+{
+	os_atomic_set_bool(&position_wanted, true);
+	if (!os_atomic_load_bool(&position_got_valid))
+		return false;
+	pan = os_atomic_load_long(&pan_got);
+	tilt = os_atomic_load_long(&tilt_got);
+	return true;
+}
+
+void visca_udp_backend::move_pantilt_absolute(int pan, int tilt, int speed_pan, int speed_tilt)
+{
+	pthread_mutex_lock(&mutex);
+	pantilt_pos_rsvd.pan = pan;
+	pantilt_pos_rsvd.tilt = tilt;
+	pantilt_pos_rsvd.speed_pan = speed_pan;
+	pantilt_pos_rsvd.speed_tilt = speed_tilt;
+	pantilt_pos_rsvd.relative = false;
+	pantilt_pos_rsvd.cnt++;
+	pthread_mutex_unlock(&mutex);
+	os_atomic_set_bool(&pantilt_pos_mode, true);
+	os_event_signal(event);
+}
+
+void visca_udp_backend::move_pantilt_relative(int pan, int tilt, int speed_pan, int speed_tilt)
+{
+	pthread_mutex_lock(&mutex);
+	pantilt_pos_rsvd.pan = pan;
+	pantilt_pos_rsvd.tilt = tilt;
+	pantilt_pos_rsvd.speed_pan = speed_pan;
+	pantilt_pos_rsvd.speed_tilt = speed_tilt;
+	pantilt_pos_rsvd.relative = true;
+	pantilt_pos_rsvd.cnt++;
+	pthread_mutex_unlock(&mutex);
+	os_atomic_set_bool(&pantilt_pos_mode, true);
+	os_event_signal(event);
+}
+
+void visca_udp_backend::move_zoom_absolute(int zoom)
+{
+	os_atomic_set_long(&zoom_pos_rsvd, zoom);
+	os_atomic_inc_long(&zoom_pos_cnt);
+	os_atomic_set_bool(&zoom_pos_mode, true);
+	os_event_signal(event);
+}
+
+void visca_udp_backend::set_config(struct obs_data *data_)
+{
+	pthread_mutex_lock(&mutex);
+
+	obs_data_addref(data_);
+	if (data) {
+		const char *address_old = obs_data_get_string(data, "address");
+		int port_old = (int)obs_data_get_int(data, "port");
+		const char *address_new = obs_data_get_string(data_, "address");
+		int port_new = (int)obs_data_get_int(data_, "port");
+		if (strcmp(address_old, address_new))
+			data_changed = true;
+		if (port_old != port_new)
+			data_changed = true;
+		obs_data_release(data);
+	}
+	else
+		data_changed = true;
+	data = data_;
+
+	long ms = (long)obs_data_get_int(data, "zoom_poll_ms");
+	if (ms < ZOOM_POLL_MIN_MS)
+		ms = ms > 0 ? ZOOM_POLL_MIN_MS : ZOOM_POLL_DEFAULT_MS;
+	os_atomic_set_long(&zoom_poll_ms, ms);
+
+	pthread_mutex_unlock(&mutex);
+
+	os_event_signal(event);
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <util/threading.h>
+#include "ptz-backend.hpp"
+#include "ptz-rtt.hpp"
+#include "visca-ip.hpp"
+
+/*
+ * PTZ backend speaking VISCA over IP on UDP.
+ * The messages are sent from a thread that keeps at most two commands in flight,
+ * which is the number of command sockets of most cameras.
+ * The inquiries and the position moves that are already acknowledged are not counted.
+ * A message without reply is retransmitted and the sequence number is reset
+ * if the camera does not reply after the retries.
+ */
+class visca_udp_backend : public ptz_backend
+{
+	enum cmd_kind_e
+	{
+		cmd_kind_none = 0,
+		cmd_kind_pantilt,
+		cmd_kind_zoom,
+		cmd_kind_preset,
+		cmd_kind_zoom_inquiry,
+		cmd_kind_position_inquiry,
+	};
+
+	struct inflight_s
+	{
+		visca_ip_message_s msg;
+		cmd_kind_e kind;
+		uint64_t sent_ns;
+		int retry;
+		bool acked;
+		bool position; // position move, which gives up the slot when acknowledged
+		bool relative; // relative position move
+		long cnt; // request count of the position move
+	};
+
+	pthread_mutex_t mutex;
+	pthread_t thread;
+	os_event_t *event; // signaled when a request arrives
+	struct obs_data *data;
+	volatile bool data_changed;
+	volatile bool preset_changed;
+	volatile long pan_rsvd, tilt_rsvd, zoom_rsvd;
+	volatile int preset_rsvd;
+	volatile long zoom_got;
+	volatile long zoom_poll_ms;
+	volatile bool pantilt_pos_mode, zoom_pos_mode; // true if the last request is a position move
+	struct ptz_position_request_s pantilt_pos_rsvd; // protected by mutex
+	volatile long zoom_pos_rsvd;
+	volatile long zoom_pos_cnt;
+	volatile bool position_wanted;
+	volatile bool position_got_valid;
+	volatile long pan_got, tilt_got;
+
+	// accessed only from the thread
+	visca_ip_socket_t sock;
+	uint32_t seq;
+	ptz_rtt rtt;
+	uint64_t next_send_ns;
+	inflight_s inflight[4]; // two commands and the two inquiries
+	int n_inflight;
+	int pan_sent, tilt_sent, zoom_sent;
+	unsigned int pantilt_pos_sent;
+	long zoom_pos_sent;
+	uint64_t zoom_poll_next_ns, position_poll_next_ns;
+
+	static void *thread_main(void *);
+	void thread_connect();
+	void thread_loop();
+	bool reset_sequence();
+	bool send_message(const visca_ip_message_s &msg);
+	inflight_s &send_command(cmd_kind_e kind, uint16_t type, const uint8_t *payload, size_t len);
+	bool send_next(uint64_t ns);
+	void receive(uint64_t timeout_ns);
+	void handle_reply(const visca_ip_message_s &msg, uint64_t ns);
+	void retransmit_expired(uint64_t ns);
+	void remove_inflight(int i, bool failed);
+	bool is_inflight(cmd_kind_e kind) const;
+	int count_commands() const;
+	bool has_pending();
+
+public:
+	visca_udp_backend();
+	~visca_udp_backend() override;
+
+	void set_config(struct obs_data *data) override; // and attempt to connect
+
+	void set_pantilt_speed(int pan, int tilt) override {
+		os_atomic_set_long(&pan_rsvd, pan);
+		os_atomic_set_long(&tilt_rsvd, tilt);
+		os_atomic_set_bool(&pantilt_pos_mode, false);
+		os_event_signal(event);
+	}
+	void set_zoom_speed(int zoom) override {
+		os_atomic_set_long(&zoom_rsvd, zoom);
+		os_atomic_set_bool(&zoom_pos_mode, false);
+		os_event_signal(event);
+	}
+	void recall_preset(int preset) override {
+		preset_rsvd = preset;
+		os_atomic_set_bool(&preset_changed, true);
+		os_event_signal(event);
+	}
+	int get_zoom() override { return os_atomic_load_long(&zoom_got); }
+
+	bool get_position(int &pan, int &tilt) override;
+	bool can_move_position() override { return true; }
+	void move_pantilt_absolute(int pan, int tilt, int speed_pan, int speed_tilt) override;
+	void move_pantilt_relative(int pan, int tilt, int speed_pan, int speed_tilt) override;
+	void move_zoom_absolute(int zoom) override;
+};
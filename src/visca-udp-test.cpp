@@ -0,0 +1,283 @@
+#include <obs-module.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include <cstdio>
+#include <cstring>
+#include <set>
+#include "plugin-macros.generated.h"
+#include "visca-ip.hpp"
+#include "visca-udp-backend.hpp"
+#include "visca-sim-server.hpp"
+
+/*
+ * Runs visca_udp_backend against visca_sim_server on the loopback address.
+ * A relay between them drops datagrams so that the backend has to retransmit
+ * and, if the camera keeps silent, to reset the sequence number.
+ */
+
+#define SERVER_PORT 52391
+#define RELAY_PORT 52392
+#define TIMEOUT_MS 5000
+#define TICK_MS 10
+
+static int n_failed = 0;
+
+#define CHECK(x) do { \
+	if (!(x)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #x); \
+		n_failed++; \
+	} \
+} while (0)
+
+class visca_test_relay
+{
+	pthread_t thread;
+	volatile bool stop_requested = false;
+	visca_ip_socket_t sock_client = VISCA_IP_INVALID_SOCKET; // the backend sends to this socket
+	visca_ip_socket_t sock_server = VISCA_IP_INVALID_SOCKET; // connected to the server
+	struct sockaddr_storage client;
+	socklen_t client_len = 0;
+	std::set<uint32_t> seqs; // sequence numbers seen since the last reset
+
+	static void *thread_main(void *data)
+	{
+		((visca_test_relay *)data)->thread_loop();
+		return NULL;
+	}
+
+	void thread_loop();
+	void from_client(const uint8_t *buf, int n);
+
+public:
+	// Protects the fields below.
+	pthread_mutex_t mutex;
+	int drop_commands = 0; // number of the next commands to drop
+	bool drop_all = false;
+	int n_reset = 0;
+	int n_retransmit = 0;
+	uint32_t seq_after_reset = 0; // sequence number of the first message after the last reset
+
+	bool start(int port, int server_port);
+	void stop();
+};
+
+bool visca_test_relay::start(int port, int server_port)
+{
+	pthread_mutex_init(&mutex, NULL);
+
+	struct sockaddr_in addr = {};
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	sock_client = socket(AF_INET, SOCK_DGRAM, 0);
+	addr.sin_port = htons((uint16_t)port);
+	if (sock_client == VISCA_IP_INVALID_SOCKET || bind(sock_client, (const struct sockaddr *)&addr, sizeof(addr)) != 0)
+		return false;
+
+	sock_server = socket(AF_INET, SOCK_DGRAM, 0);
+	addr.sin_port = htons((uint16_t)server_port);
+	if (sock_server == VISCA_IP_INVALID_SOCKET || connect(sock_server, (const struct sockaddr *)&addr, sizeof(addr)) != 0)
+		return false;
+
+	pthread_create(&thread, NULL, visca_test_relay::thread_main, (void *)this);
+	return true;
+}
+
+void visca_test_relay::stop()
+{
+	os_atomic_set_bool(&stop_requested, true);
+	pthread_join(thread, NULL);
+	visca_ip_closesocket(sock_client);
+	visca_ip_closesocket(sock_server);
+	pthread_mutex_destroy(&mutex);
+}
+
+void visca_test_relay::thread_loop()
+{
+	while (!os_atomic_load_bool(&stop_requested)) {
+		struct timeval tv;
+		tv.tv_sec = 0;
+		tv.tv_usec = TICK_MS * 1000;
+		fd_set fds;
+		FD_ZERO(&fds);
+		FD_SET(sock_client, &fds);
+		FD_SET(sock_server, &fds);
+		int nfds = (int)(sock_client > sock_server ? sock_client : sock_server) + 1;
+		if (select(nfds, &fds, NULL, NULL, &tv) <= 0)
+			continue;
+
+		uint8_t buf[VISCA_IP_HEADER_SIZE + VISCA_IP_PAYLOAD_MAX];
+		if (FD_ISSET(sock_client, &fds)) {
+			client_len = sizeof(client);
+			int n = (int)recvfrom(sock_client, (char *)buf, sizeof(buf), 0, (struct sockaddr *)&client, &client_len);
+			if (n > 0)
+				from_client(buf, n);
+		}
+		if (FD_ISSET(sock_server, &fds)) {
+			int n = (int)recv(sock_server, (char *)buf, sizeof(buf), 0);
+			pthread_mutex_lock(&mutex);
+			bool drop = drop_all;
+			pthread_mutex_unlock(&mutex);
+			if (n > 0 && client_len > 0 && !drop)
+				sendto(sock_client, (const char *)buf, n, 0, (const struct sockaddr *)&client, client_len);
+		}
+	}
+}
+
+void visca_test_relay::from_client(const uint8_t *buf, int n)
+{
+	visca_ip_message_s msg;
+	if (!visca_ip_unpack(msg, buf, (size_t)n))
+		return;
+
+	bool drop = false;
+	pthread_mutex_lock(&mutex);
+	if (msg.type == visca_ip_type_control) {
+		n_reset++;
+		seqs.clear();
+		seq_after_reset = 0;
+	}
+	else {
+		if (seqs.empty())
+			seq_after_reset = msg.seq;
+		if (!seqs.insert(msg.seq).second)
+			n_retransmit++;
+		if (msg.type == visca_ip_type_command && drop_commands > 0) {
+			drop_commands--;
+			drop = true;
+		}
+	}
+	if (drop_all)
+		drop = true;
+	pthread_mutex_unlock(&mutex);
+
+	if (!drop)
+		send(sock_server, (const char *)buf, n, 0);
+}
+
+// Ticks the camera until the condition holds. Returns false if it does not hold within TIMEOUT_MS.
+template <typename F> static bool wait_for(visca_sim_server &server, F cond)
+{
+	for (int ms = 0; ms < TIMEOUT_MS; ms += TICK_MS) {
+		pthread_mutex_lock(&server.mutex);
+		server.camera.tick(TICK_MS * 1e-3f);
+		bool ret = cond();
+		pthread_mutex_unlock(&server.mutex);
+		if (ret)
+			return true;
+		os_sleep_ms(TICK_MS);
+	}
+	return false;
+}
+
+static void test_framing()
+{
+	const uint8_t payload[] = {0x81, 0x01, 0x04, 0x07, 0x00, 0xFF};
+	visca_ip_message_s msg;
+	msg.type = visca_ip_type_command;
+	msg.seq = 0x01020304;
+	visca_ip_set_payload(msg, payload, sizeof(payload));
+
+	uint8_t buf[VISCA_IP_HEADER_SIZE + VISCA_IP_PAYLOAD_MAX];
+	size_t n = visca_ip_pack(buf, msg);
+	const uint8_t header[] = {0x01, 0x00, 0x00, 0x06, 0x01, 0x02, 0x03, 0x04};
+	CHECK(n == VISCA_IP_HEADER_SIZE + sizeof(payload));
+	CHECK(memcmp(buf, header, sizeof(header)) == 0);
+	CHECK(memcmp(buf + VISCA_IP_HEADER_SIZE, payload, sizeof(payload)) == 0);
+
+	visca_ip_message_s got;
+	CHECK(visca_ip_unpack(got, buf, n));
+	CHECK(got.type == msg.type);
+	CHECK(got.seq == msg.seq);
+	CHECK(got.len == sizeof(payload));
+	CHECK(memcmp(got.payload, payload, sizeof(payload)) == 0);
+
+	CHECK(!visca_ip_unpack(got, buf, VISCA_IP_HEADER_SIZE - 1)); // short header
+	CHECK(!visca_ip_unpack(got, buf, n - 1)); // truncated payload
+	buf[3] = VISCA_IP_PAYLOAD_MAX + 1;
+	CHECK(!visca_ip_unpack(got, buf, sizeof(buf))); // too long payload
+
+	uint8_t nibbles[4];
+	visca_int_to_nibbles(nibbles, -300 & 0xFFFF, 4);
+	CHECK(nibbles[0] == 0x0F && nibbles[1] == 0x0E && nibbles[2] == 0x0D && nibbles[3] == 0x04);
+	CHECK((int16_t)visca_nibbles_to_int(nibbles, 4) == -300);
+}
+
+static void test_backend(visca_sim_server &server, visca_test_relay &relay)
+{
+	auto *dev = new visca_udp_backend();
+	obs_data_t *data = obs_data_create();
+	obs_data_set_string(data, "address", "127.0.0.1");
+	obs_data_set_int(data, "port", RELAY_PORT);
+	obs_data_set_int(data, "zoom_poll_ms", 20);
+	dev->set_config(data);
+	obs_data_release(data);
+
+	// Connecting resets the sequence number, then the zoom is polled.
+	CHECK(wait_for(server, [&]() {
+		pthread_mutex_lock(&relay.mutex);
+		bool ret = relay.n_reset > 0;
+		pthread_mutex_unlock(&relay.mutex);
+		return ret;
+	}));
+	dev->move_zoom_absolute(4000);
+	CHECK(wait_for(server, [&]() { return dev->get_zoom() == 4000; }));
+
+	// A lost command is retransmitted with the same sequence number.
+	pthread_mutex_lock(&relay.mutex);
+	relay.drop_commands = 1;
+	relay.n_retransmit = 0;
+	pthread_mutex_unlock(&relay.mutex);
+	dev->move_pantilt_absolute(200, -100, 0x18, 0x14);
+	CHECK(wait_for(server, [&]() { return server.camera.pan == 200.0f && server.camera.tilt == -100.0f; }));
+	pthread_mutex_lock(&relay.mutex);
+	CHECK(relay.drop_commands == 0);
+	CHECK(relay.n_retransmit > 0);
+	pthread_mutex_unlock(&relay.mutex);
+
+	// If the camera keeps silent, the sequence number is reset and the request is sent again from 1.
+	pthread_mutex_lock(&relay.mutex);
+	const int n_reset = relay.n_reset;
+	relay.drop_all = true;
+	pthread_mutex_unlock(&relay.mutex);
+	dev->move_zoom_absolute(1000);
+	CHECK(wait_for(server, [&]() {
+		pthread_mutex_lock(&relay.mutex);
+		bool ret = relay.n_reset > n_reset;
+		pthread_mutex_unlock(&relay.mutex);
+		return ret;
+	}));
+	pthread_mutex_lock(&relay.mutex);
+	relay.drop_all = false;
+	pthread_mutex_unlock(&relay.mutex);
+	CHECK(wait_for(server, [&]() { return dev->get_zoom() == 1000; }));
+	pthread_mutex_lock(&relay.mutex);
+	CHECK(relay.seq_after_reset == 1);
+	pthread_mutex_unlock(&relay.mutex);
+
+	dev->release();
+}
+
+int main()
+{
+	test_framing();
+
+	visca_sim_server server;
+	visca_test_relay relay;
+	if (!server.start(SERVER_PORT) || !relay.start(RELAY_PORT, SERVER_PORT)) {
+		fprintf(stderr, "failed to open the sockets\n");
+		return 1;
+	}
+
+	test_backend(server, relay);
+
+	relay.stop();
+	server.stop();
+
+	if (n_failed) {
+		fprintf(stderr, "%d check(s) failed\n", n_failed);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
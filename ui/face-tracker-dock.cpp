@@ -358,7 +358,7 @@ void FTDock::updateState()
 	in_updateState = true;
 
 	calldata_t cd;
-	uint8_t stack[128];
+	uint8_t stack[256];
 	calldata_init_fixed(&cd, stack, sizeof(stack));
 	if (proc_handler_call(ph, "get_state", &cd)) {
 		bool b;